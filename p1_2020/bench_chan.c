@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mythread.h"
+
+/* Channel pipeline benchmark.
+   A source thread sends BENCH_MESSAGES pointers through BENCH_STAGES threads, each one
+   receiving from the channel before it and sending to the one after it, to a sink that
+   checks they arrive in order. Run once per channel capacity, each run in its own
+   process since the library ends the process when the last thread finishes.
+   It prints one JSON object per capacity on stdout with the messages per second through
+   the whole pipeline.
+   Usage: bench_chan [policy] [workers] */
+
+#define BENCH_STAGES 4
+#define BENCH_MESSAGES 200000
+#define BENCH_TIMEOUT 60
+
+static const char *policy = "rrs";
+static int workers = 1;
+static int capacity;
+static int result_fd;
+
+static mythread_chan_t *chans[BENCH_STAGES + 1];
+static long *messages;
+static int next_stage;
+static double start;
+
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void source(int arg)
+{
+  long i;
+
+  start = now_ns();
+  for (i = 0; i < BENCH_MESSAGES; i++) mythread_chan_send(chans[0], &messages[i]);
+  mythread_chan_close(chans[0]);
+}
+
+/* The argument of a thread is its time limit, so each stage takes the next index */
+static void stage(int arg)
+{
+  int n = __atomic_fetch_add(&next_stage, 1, __ATOMIC_RELAXED);
+  void *msg;
+
+  while (mythread_chan_recv(chans[n], &msg) == 0) mythread_chan_send(chans[n + 1], msg);
+  mythread_chan_close(chans[n + 1]);
+}
+
+static void sink(int arg)
+{
+  void *msg;
+  long received = 0, errors = 0;
+  double elapsed;
+
+  //The very same objects, in the order they were sent
+  while (mythread_chan_recv(chans[BENCH_STAGES], &msg) == 0)
+    if (msg != &messages[received++]) errors++;
+  elapsed = now_ns() - start;
+  dprintf(result_fd, "{\"policy\":\"%s\",\"workers\":%d,\"stages\":%d,\"capacity\":%d,\"messages\":%ld,"
+          "\"errors\":%ld,\"elapsed_s\":%.6f,\"messages_per_sec\":%.1f}\n",
+          policy, workers, BENCH_STAGES, capacity, received, errors, elapsed / 1e9,
+          received / (elapsed / 1e9));
+}
+
+/* Body of the child process: never returns, the library exits at FINISH */
+static void run_pipeline()
+{
+  int devnull = open("/dev/null", O_WRONLY);
+  int i;
+
+  /* The library messages are not part of the results */
+  dup2(devnull, STDOUT_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  alarm(BENCH_TIMEOUT);
+  mythread_set_workers(workers);
+
+  messages = malloc(BENCH_MESSAGES * sizeof(long));
+  for (i = 0; i <= BENCH_STAGES; i++) chans[i] = mythread_chan_new(capacity);
+  if (messages == NULL || mythread_create(sink, LOW_PRIORITY, 0) < 0 ||
+      mythread_create(source, LOW_PRIORITY, 0) < 0)
+  {
+    dprintf(result_fd, "{\"policy\":\"%s\",\"error\":\"setup\"}\n", policy);
+    exit(-1);
+  }
+  for (i = 0; i < BENCH_STAGES; i++)
+  {
+    if (mythread_create(stage, LOW_PRIORITY, 0) < 0)
+    {
+      dprintf(result_fd, "{\"policy\":\"%s\",\"error\":\"mythread_create\"}\n", policy);
+      exit(-1);
+    }
+  }
+  mythread_exit();
+  exit(-1);
+}
+
+static void pipeline(int cap)
+{
+  char buf[1024];
+  int fds[2], n, status;
+  pid_t pid;
+
+  capacity = cap;
+  if (pipe(fds) == -1)
+  {
+    perror("*** ERROR: pipe");
+    exit(-1);
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1)
+  {
+    perror("*** ERROR: fork");
+    exit(-1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    result_fd = fds[1];
+    run_pipeline();
+  }
+  close(fds[1]);
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) fwrite(buf, 1, n, stdout);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status))
+    printf("{\"policy\":\"%s\",\"capacity\":%d,\"error\":\"killed by signal %d\"}\n", policy, cap, WTERMSIG(status));
+}
+
+
+int main(int argc, char *argv[])
+{
+  int capacities[] = {0, 1, 16, 256, MYTHREAD_CHAN_UNBOUNDED};
+  int i;
+
+  if (argc > 1) policy = argv[1];
+  if (argc > 2) workers = atoi(argv[2]);
+  if (mythread_set_policy(policy) < 0)
+  {
+    fprintf(stderr, "*** ERROR: unknown scheduling policy %s\n", policy);
+    exit(-1);
+  }
+  for (i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++) pipeline(capacities[i]);
+  return 0;
+}
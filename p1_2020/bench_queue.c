@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "queue.h"
+#include "heap.h"
+
+/* Microbenchmark of the ready queue operations done on every context switch:
+   the preempted thread is enqueued and the next one is dequeued.
+   Compares the malloc based queues with the intrusive TCB queue (FIFO) and the TCB
+   heap (sorted). A sorted list linked through the TCBs was slower than the malloc one,
+   every step of its walk reads another TCB: it was dropped for the heap.
+   The sorted queues run two workloads. With random keys the preempted thread gets a
+   key of its own, like the remaining ticks of SJF: the smallest ones are taken first,
+   so most of the queue holds large keys and a new key is found near the head of a
+   list. With advancing keys the preempted thread goes after the one that ran, by a
+   random step, as the virtual run time of cfs and the deadlines of edf do: a list is
+   walked half way. Every figure is the best of BENCH_RUNS runs */
+
+#define THREADS 1000
+#define ITERATIONS 200000
+#define BENCH_RUNS 5
+
+static TCB tcbs[THREADS];
+/* Pseudo-random keys of the preempted threads, or steps of their key */
+static int keys[ITERATIONS];
+/* Current key of every thread, advancing keys */
+static long thread_key[THREADS];
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Key of t when it is queued again at switch i */
+static inline long next_key(TCB *t, int i, int advancing)
+{
+  if (!advancing) return keys[i];
+  thread_key[t->tid] += keys[i];
+  return thread_key[t->tid];
+}
+
+static void reset_keys()
+{
+  int i;
+
+  for (i = 0; i < THREADS; i++) thread_key[i] = keys[i];
+}
+
+/* FIFO switch (low priority): enqueue + dequeue */
+static double bench_fifo_old(int advancing)
+{
+  struct queue *q = queue_new();
+  int i;
+  double start;
+  TCB *t;
+
+  for (i = 0; i < THREADS; i++) enqueue(q, &tcbs[i]);
+  start = now_ns();
+  for (i = 0; i < ITERATIONS; i++) {
+    t = dequeue(q);
+    enqueue(q, t);
+  }
+  start = (now_ns() - start) / ITERATIONS;
+  while (dequeue(q) != NULL);
+  free(q);
+  return start;
+}
+
+static double bench_fifo_new(int advancing)
+{
+  struct tcb_queue *q = tcb_queue_new();
+  int i;
+  double start;
+  TCB *t;
+
+  for (i = 0; i < THREADS; i++) tcb_enqueue(q, &tcbs[i]);
+  start = now_ns();
+  for (i = 0; i < ITERATIONS; i++) {
+    t = tcb_dequeue(q);
+    tcb_enqueue(q, t);
+  }
+  start = (now_ns() - start) / ITERATIONS;
+  free(q);
+  return start;
+}
+
+/* Sorted switch: sorted enqueue + dequeue of the smallest key */
+static double bench_sorted_old(int advancing)
+{
+  struct queue *q = queue_new();
+  int i;
+  double start;
+  TCB *t;
+
+  reset_keys();
+  for (i = 0; i < THREADS; i++) sorted_enqueue(q, &tcbs[i], thread_key[i]);
+  start = now_ns();
+  for (i = 0; i < ITERATIONS; i++) {
+    t = dequeue(q);
+    sorted_enqueue(q, t, next_key(t, i, advancing));
+  }
+  start = (now_ns() - start) / ITERATIONS;
+  while (dequeue(q) != NULL);
+  free(q);
+  return start;
+}
+
+static double bench_sorted_heap(int advancing)
+{
+  struct tcb_heap *h = tcb_heap_new(THREADS);
+  int i;
+  double start;
+  TCB *t;
+
+  reset_keys();
+  for (i = 0; i < THREADS; i++) tcb_heap_push(h, &tcbs[i], thread_key[i]);
+  start = now_ns();
+  for (i = 0; i < ITERATIONS; i++) {
+    t = tcb_heap_pop(h);
+    tcb_heap_push(h, t, next_key(t, i, advancing));
+  }
+  start = (now_ns() - start) / ITERATIONS;
+  free(h->nodes);
+  free(h);
+  return start;
+}
+
+/* Best of BENCH_RUNS runs, in ns per switch */
+static double best(double (*bench)(int), int advancing)
+{
+  double ns, min = 0;
+  int i;
+
+  for (i = 0; i < BENCH_RUNS; i++) {
+    ns = bench(advancing);
+    if (i == 0 || ns < min) min = ns;
+  }
+  return min;
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  for (i = 0; i < THREADS; i++) tcbs[i].tid = i;
+  srand(1);
+  for (i = 0; i < ITERATIONS; i++) keys[i] = rand() % (10 * THREADS);
+
+  printf("queue operation cost per switch (%d threads, %d switches, best of %d)\n", THREADS, ITERATIONS,
+         BENCH_RUNS);
+  printf("%-16s %12s %12s\n", "", "malloc", "intrusive");
+  printf("%-16s %9.1f ns %9.1f ns\n", "fifo", best(bench_fifo_old, 0), best(bench_fifo_new, 0));
+  printf("%-16s %9.1f ns %9.1f ns (heap)\n", "sorted random", best(bench_sorted_old, 0),
+         best(bench_sorted_heap, 0));
+  printf("%-16s %9.1f ns %9.1f ns (heap)\n", "sorted advancing", best(bench_sorted_old, 1),
+         best(bench_sorted_heap, 1));
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mythread.h"
+
+/* Scheduler benchmark of one scheduling policy (see policy.h).
+   Every workload runs in its own process, since the library ends the process when the
+   last thread finishes. It prints one JSON object per workload on stdout:
+   - cpu: BENCH_THREADS CPU bound threads share a fixed amount of work. A thread notices
+     it was switched out when its clock jumps: that gives the context switches per second
+     and the scheduling latency (time spent ready, waiting for the CPU) percentiles.
+     The overhead is the extra CPU time over the same work run without the library.
+   - create: BENCH_CREATE threads that exit at once, creations + exits per second.
+   Usage: bench_sched [policy] [tick_ns] */
+
+#define BENCH_THREADS 4
+#define BENCH_CREATE 10000
+#define BENCH_WORK_NS 500000000.0 /* Length of the cpu workload without the library */
+#define BENCH_SAMPLES (1 << 16)
+#define BENCH_TIMEOUT 60
+
+static const char *policy = "rrs";
+static long tick_ns = 100000;
+/* Clock jumps longer than half a tick are switches, shorter ones are interrupts */
+static double gap_ns;
+static long iterations; /* Per thread, cpu workload */
+static double baseline_ns; /* CPU time of the cpu workload without the library */
+static int result_fd;
+
+static double start, start_cpu;
+static int finished = 0;
+static long switches = 0;
+static double samples[BENCH_SAMPLES];
+static int nsamples = 0;
+
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double cpu_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* The unit of work of the cpu workload, the same with and without the library */
+static void work(long n)
+{
+  double last = now_ns(), t;
+  long i;
+
+  for (i = 0; i < n; i++)
+  {
+    t = now_ns();
+    if (t - last > gap_ns)
+    {
+      int s = __atomic_fetch_add(&nsamples, 1, __ATOMIC_RELAXED);
+      if (s < BENCH_SAMPLES) samples[s] = t - last;
+      __atomic_add_fetch(&switches, 1, __ATOMIC_RELAXED);
+    }
+    last = t;
+  }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(double *v, int n, double p)
+{
+  int i = (int)(p * (n - 1));
+  return n > 0 ? v[i] : 0.0;
+}
+
+static void cpu_thread(int arg)
+{
+  work(iterations);
+  if (__atomic_add_fetch(&finished, 1, __ATOMIC_SEQ_CST) == BENCH_THREADS)
+  {
+    double elapsed = now_ns() - start;
+    double cpu = cpu_ns() - start_cpu;
+    int n = nsamples < BENCH_SAMPLES ? nsamples : BENCH_SAMPLES;
+
+    qsort(samples, n, sizeof(double), compare_double);
+    dprintf(result_fd, "{\"policy\":\"%s\",\"workload\":\"cpu\",\"threads\":%d,\"tick_ns\":%ld,"
+            "\"elapsed_s\":%.6f,\"switches_per_sec\":%.1f,"
+            "\"latency_p50_us\":%.3f,\"latency_p90_us\":%.3f,\"latency_p99_us\":%.3f,\"latency_max_us\":%.3f,"
+            "\"overhead_pct\":%.2f}\n",
+            policy, BENCH_THREADS, tick_ns, elapsed / 1e9, switches / (elapsed / 1e9),
+            percentile(samples, n, 0.5) / 1e3, percentile(samples, n, 0.9) / 1e3,
+            percentile(samples, n, 0.99) / 1e3, n > 0 ? samples[n - 1] / 1e3 : 0.0,
+            100.0 * (cpu - baseline_ns) / cpu);
+  }
+}
+
+static void create_thread(int arg)
+{
+  if (__atomic_add_fetch(&finished, 1, __ATOMIC_SEQ_CST) == BENCH_CREATE)
+  {
+    double elapsed = now_ns() - start;
+
+    dprintf(result_fd, "{\"policy\":\"%s\",\"workload\":\"create\",\"threads\":%d,\"tick_ns\":%ld,"
+            "\"elapsed_s\":%.6f,\"create_exit_per_sec\":%.1f}\n",
+            policy, BENCH_CREATE, tick_ns, elapsed / 1e9, BENCH_CREATE / (elapsed / 1e9));
+  }
+}
+
+/* Body of the child process: never returns, the library exits at FINISH */
+static void run_workload(void (*body)(int), int threads)
+{
+  int devnull = open("/dev/null", O_WRONLY);
+  int i;
+
+  /* The library messages are not part of the results */
+  dup2(devnull, STDOUT_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  alarm(BENCH_TIMEOUT);
+  set_tick(CLOCK_MONOTONIC, tick_ns, 0);
+
+  start = now_ns();
+  start_cpu = cpu_ns();
+  for (i = 0; i < threads; i++)
+  {
+    /* seconds = 0: the threads are not limited in time, they end when body returns */
+    if (mythread_create(body, LOW_PRIORITY, 0) < 0)
+    {
+      dprintf(result_fd, "{\"policy\":\"%s\",\"error\":\"mythread_create\"}\n", policy);
+      exit(-1);
+    }
+  }
+  mythread_exit();
+  exit(-1);
+}
+
+static void workload(void (*body)(int), int threads)
+{
+  char buf[1024];
+  int fds[2], n, status;
+  pid_t pid;
+
+  if (pipe(fds) == -1)
+  {
+    perror("*** ERROR: pipe");
+    exit(-1);
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1)
+  {
+    perror("*** ERROR: fork");
+    exit(-1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    result_fd = fds[1];
+    run_workload(body, threads);
+  }
+  close(fds[1]);
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) fwrite(buf, 1, n, stdout);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status))
+    printf("{\"policy\":\"%s\",\"error\":\"killed by signal %d\"}\n", policy, WTERMSIG(status));
+}
+
+
+int main(int argc, char *argv[])
+{
+  double t;
+  int i;
+
+  if (argc > 1) policy = argv[1];
+  if (argc > 2) tick_ns = atol(argv[2]);
+  if (mythread_set_policy(policy) < 0)
+  {
+    fprintf(stderr, "*** ERROR: unknown scheduling policy %s\n", policy);
+    exit(-1);
+  }
+  gap_ns = tick_ns / 2.0;
+
+  /* Calibrate the cpu workload and measure it without the library (best of 3) */
+  t = now_ns();
+  work(1000000);
+  iterations = BENCH_WORK_NS / ((now_ns() - t) / 1000000) / BENCH_THREADS;
+  for (i = 0; i < 3; i++)
+  {
+    t = cpu_ns();
+    work(iterations * BENCH_THREADS);
+    t = cpu_ns() - t;
+    if (i == 0 || t < baseline_ns) baseline_ns = t;
+  }
+  switches = 0;
+  nsamples = 0;
+
+  workload(cpu_thread, BENCH_THREADS);
+  workload(create_thread, BENCH_CREATE);
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "context.h"
+#include "stack_pool.h"
+
+/* Context switch microbenchmark: two contexts switching back and forth.
+   Compares the swapcontext path used before with the mctx_switch of context.c */
+
+#define SWITCHES 1000000
+#define BENCH_STACKSIZE 65536
+
+static ucontext_t uc_main, uc_other;
+static mctx_t mc_main, mc_other;
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void uc_function()
+{
+  while (1) swapcontext(&uc_other, &uc_main);
+}
+
+static void mc_function(void *arg)
+{
+  while (1) mctx_switch(&mc_other, &mc_main);
+}
+
+static double bench_ucontext()
+{
+  size_t size = stack_round(BENCH_STACKSIZE);
+  double start;
+  int i;
+
+  getcontext(&uc_other);
+  uc_other.uc_stack.ss_sp = stack_alloc(size);
+  uc_other.uc_stack.ss_size = size;
+  uc_other.uc_link = NULL;
+  makecontext(&uc_other, uc_function, 0);
+
+  start = now_ns();
+  for (i = 0; i < SWITCHES / 2; i++) swapcontext(&uc_main, &uc_other);
+  return (now_ns() - start) / SWITCHES;
+}
+
+static double bench_mctx()
+{
+  size_t size = stack_round(BENCH_STACKSIZE);
+  double start;
+  int i;
+
+  mctx_make(&mc_other, stack_alloc(size), size, mc_function, NULL);
+
+  start = now_ns();
+  for (i = 0; i < SWITCHES / 2; i++) mctx_switch(&mc_main, &mc_other);
+  return (now_ns() - start) / SWITCHES;
+}
+
+int main(int argc, char *argv[])
+{
+  double uc = bench_ucontext();
+  double mc = bench_mctx();
+
+#ifdef MCTX_FAST
+  printf("mctx_switch: hand written (no signal mask syscall)\n");
+#else
+  printf("mctx_switch: ucontext fallback\n");
+#endif
+  printf("%-12s %8.1f ns/switch %12.0f switches/s\n", "swapcontext", uc, 1e9 / uc);
+  printf("%-12s %8.1f ns/switch %12.0f switches/s\n", "mctx_switch", mc, 1e9 / mc);
+  return 0;
+}
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mythread.h"
+#include "tcb_store.h"
+#include "wait.h"
+
+/* Channels of pointers between threads.
+   The messages sent and not received yet are kept in a ring of capacity slots, which
+   doubles when it is full if the channel is unbounded. With capacity 0 there is no ring:
+   the sender waits until a receiver takes its message.
+   A thread that can not go on is parked (see wait.h) with a waiter on the list of
+   senders or of receivers of the channel. The one that unblocks it does its operation
+   for it: a sender hands its message straight to a parked receiver, and a receiver that
+   frees a slot moves the message of the first parked sender into the ring.
+   mythread_chan_select() parks a thread on several lists at once, with one waiter per
+   operation on its stack. The first thread that claims it (see wait_claim) does that
+   operation, and it unlinks the other waiters itself when it runs again. The channels of
+   a select are locked in address order, so two selects never wait for each other.
+   send and recv are a select of one operation */
+
+struct chan_waiter
+{
+  TCB *thread;
+  struct mythread_chan_op *op; /* Message to send, or where the received one goes */
+  int index; /* Of the operation in the select */
+  int queued; /* Still in the list of the channel */
+  struct chan_waiter *next;
+  struct chan_waiter *prev;
+};
+
+struct chan_wait_list
+{
+  struct chan_waiter *head;
+  struct chan_waiter *tail;
+};
+
+struct mythread_chan
+{
+  int lock; /* Protects everything below */
+  int capacity;
+  int closed;
+  void **ring;
+  int size;
+  int first;
+  int count;
+  struct chan_wait_list senders;
+  struct chan_wait_list receivers;
+};
+
+/* Channels of a select, each one once and in address order */
+struct chan_set
+{
+  mythread_chan_t **chans;
+  int n;
+};
+
+
+static void wait_list_append(struct chan_wait_list *l, struct chan_waiter *w)
+{
+  w->next = NULL;
+  w->prev = l->tail;
+  if (l->tail != NULL) l->tail->next = w;
+  else l->head = w;
+  l->tail = w;
+  w->queued = 1;
+}
+
+static void wait_list_unlink(struct chan_wait_list *l, struct chan_waiter *w)
+{
+  if (w->prev != NULL) w->prev->next = w->next;
+  else l->head = w->next;
+  if (w->next != NULL) w->next->prev = w->prev;
+  else l->tail = w->prev;
+  w->next = w->prev = NULL;
+  w->queued = 0;
+}
+
+/* First waiter of the list whose thread is still parked, taken for the caller. The ones
+   that timed out or were taken by another channel of their select are dropped */
+static struct chan_waiter* wait_list_claim(struct chan_wait_list *l)
+{
+  struct chan_waiter *w;
+
+  while ((w = l->head) != NULL) {
+    wait_list_unlink(l, w);
+    if (wait_claim(w->thread)) return w;
+  }
+  return NULL;
+}
+
+/* Tells a claimed waiter which operation was done, and resumes it */
+static void wake_waiter(struct chan_waiter *w)
+{
+  w->thread->wait_result = w->index;
+  wait_resume(w->thread);
+}
+
+
+static void ring_push(mythread_chan_t *ch, void *msg)
+{
+  void **ring;
+  int i, size;
+
+  //Only an unbounded channel can be full here
+  if (ch->count == ch->size) {
+    size = ch->size > 0 ? 2 * ch->size : 16;
+    ring = malloc(size * sizeof(void *));
+    if (ring == NULL)
+    {
+      printf("*** ERROR: failed to grow the channel\n");
+      exit(-1);
+    }
+    for (i = 0; i < ch->count; i++) ring[i] = ch->ring[(ch->first + i) % ch->size];
+    free(ch->ring);
+    ch->ring = ring;
+    ch->size = size;
+    ch->first = 0;
+  }
+  ch->ring[(ch->first + ch->count) % ch->size] = msg;
+  ch->count++;
+}
+
+static void* ring_pop(mythread_chan_t *ch)
+{
+  void *msg = ch->ring[ch->first];
+
+  ch->first = (ch->first + 1) % ch->size;
+  ch->count--;
+  return msg;
+}
+
+
+/* Does op on its channel if it can be done now, with the channel locked.
+   Returns 1 if it was done (or the channel is closed), 0 otherwise */
+static int try_op(struct mythread_chan_op *op)
+{
+  mythread_chan_t *ch = op->chan;
+  struct chan_waiter *w;
+
+  if (op->send) {
+    if (ch->closed) {
+      op->closed = 1;
+      return 1;
+    }
+    //Straight to a parked receiver, the ring is empty then
+    if ((w = wait_list_claim(&ch->receivers)) != NULL) {
+      w->op->msg = op->msg;
+      wake_waiter(w);
+      return 1;
+    }
+    if (ch->capacity < 0 || ch->count < ch->capacity) {
+      ring_push(ch, op->msg);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (ch->count > 0) {
+    op->msg = ring_pop(ch);
+    //The slot goes to the first parked sender
+    if ((w = wait_list_claim(&ch->senders)) != NULL) {
+      ring_push(ch, w->op->msg);
+      wake_waiter(w);
+    }
+    return 1;
+  }
+  //Capacity 0: from the sender itself
+  if ((w = wait_list_claim(&ch->senders)) != NULL) {
+    op->msg = w->op->msg;
+    wake_waiter(w);
+    return 1;
+  }
+  if (ch->closed) {
+    op->msg = NULL;
+    op->closed = 1;
+    return 1;
+  }
+  return 0;
+}
+
+
+static void lock_set(struct chan_set *set)
+{
+  int i;
+
+  for (i = 0; i < set->n; i++) wait_lock(&set->chans[i]->lock);
+}
+
+static void unlock_set(void *arg)
+{
+  struct chan_set *set = arg;
+  int i;
+
+  for (i = set->n - 1; i >= 0; i--) wait_unlock(&set->chans[i]->lock);
+}
+
+
+mythread_chan_t* mythread_chan_new(int capacity)
+{
+  mythread_chan_t *ch = calloc(1, sizeof(mythread_chan_t));
+
+  if (ch == NULL) return NULL;
+  ch->capacity = capacity < 0 ? MYTHREAD_CHAN_UNBOUNDED : capacity;
+  if (capacity > 0) {
+    ch->ring = malloc(capacity * sizeof(void *));
+    if (ch->ring == NULL) {
+      free(ch);
+      return NULL;
+    }
+    ch->size = capacity;
+  }
+  return ch;
+}
+
+/* Returns -1 if a thread waits on it */
+int mythread_chan_free(mythread_chan_t *ch)
+{
+  if (ch->senders.head != NULL || ch->receivers.head != NULL) return -1;
+  free(ch->ring);
+  free(ch);
+  return 0;
+}
+
+/* The parked senders fail, and so do the parked receivers since the ring is empty */
+int mythread_chan_close(mythread_chan_t *ch)
+{
+  struct chan_waiter *w;
+
+  wait_lock(&ch->lock);
+  ch->closed = 1;
+  while ((w = wait_list_claim(&ch->senders)) != NULL) {
+    w->op->closed = 1;
+    wake_waiter(w);
+  }
+  while ((w = wait_list_claim(&ch->receivers)) != NULL) {
+    w->op->msg = NULL;
+    w->op->closed = 1;
+    wake_waiter(w);
+  }
+  wait_unlock(&ch->lock);
+  return 0;
+}
+
+int mythread_chan_send(mythread_chan_t *ch, void *msg)
+{
+  struct mythread_chan_op op = { ch, 1, msg, 0 };
+
+  mythread_chan_select(&op, 1, -1);
+  return op.closed ? -1 : 0;
+}
+
+int mythread_chan_recv(mythread_chan_t *ch, void **msg)
+{
+  struct mythread_chan_op op = { ch, 0, NULL, 0 };
+
+  mythread_chan_select(&op, 1, -1);
+  *msg = op.msg;
+  return op.closed ? -1 : 0;
+}
+
+/* The operations are tried in order, so the first ones go first when several can be
+   done. An operation on a closed channel can always be done, it sets closed */
+int mythread_chan_select(struct mythread_chan_op *ops, int n, long long nsec)
+{
+  mythread_chan_t *chans[n > 0 ? n : 1], *ch;
+  struct chan_waiter waiters[n > 0 ? n : 1];
+  struct chan_set set = { chans, 0 };
+  TCB *self;
+  int i, j, ret;
+
+  self = tcb_get(mythread_gettid());
+  if (n <= 0) return -1;
+
+  for (i = 0; i < n; i++) {
+    ops[i].closed = 0;
+    //Insertion sort by address, without repetitions
+    ch = ops[i].chan;
+    for (j = set.n; j > 0 && chans[j - 1] > ch; j--);
+    if (j > 0 && chans[j - 1] == ch) continue;
+    memmove(&chans[j + 1], &chans[j], (set.n - j) * sizeof(mythread_chan_t *));
+    chans[j] = ch;
+    set.n++;
+  }
+
+  lock_set(&set);
+  for (i = 0; i < n; i++) {
+    if (try_op(&ops[i])) {
+      unlock_set(&set);
+      return i;
+    }
+  }
+  if (nsec == 0) {
+    unlock_set(&set);
+    return -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    waiters[i].thread = self;
+    waiters[i].op = &ops[i];
+    waiters[i].index = i;
+    wait_list_append(ops[i].send ? &ops[i].chan->senders : &ops[i].chan->receivers, &waiters[i]);
+  }
+  //The operation is done by the thread that resumes us
+  ret = wait_park_unlock(unlock_set, &set, nsec);
+
+  lock_set(&set);
+  for (i = 0; i < n; i++)
+    if (waiters[i].queued)
+      wait_list_unlink(ops[i].send ? &ops[i].chan->senders : &ops[i].chan->receivers, &waiters[i]);
+  unlock_set(&set);
+  return ret;
+}
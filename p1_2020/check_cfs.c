@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+
+/* Checks of the cfs policy, driving its run queue directly with TCBs that never run:
+   the virtual run time advances by the weight of the nice value, the thread that ran the
+   least is picked first, and a thread that waited comes back with at most one latency
+   period of advantage (the sleeper credit). Single threaded, no interrupts.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_cfs */
+
+static int failures = 0;
+
+
+static void check(const char *name, int ok, const char *detail)
+{
+  printf("%-4s %-6s %-22s %s\n", ok ? "ok" : "FAIL", "cfs", name, detail);
+  if (!ok) failures++;
+}
+
+/* A ready low priority thread, as mythread_create() leaves it */
+static TCB *new_thread(int tid, int nice)
+{
+  TCB *t = calloc(1, sizeof(TCB));
+
+  if (t == NULL)
+  {
+    perror("*** ERROR: calloc");
+    exit(-1);
+  }
+  t->tid = tid;
+  t->state = INIT;
+  t->priority = LOW_PRIORITY;
+  t->ticks = QUANTUM_TICKS;
+  t->nice = nice;
+  t->level = -1;
+  return t;
+}
+
+
+/* 100 ticks at nice 0 are 100 ticks of virtual run time, at nice -5 (weight 3121)
+   about a third of that, and at nice 5 (weight 335) about three times as much */
+static void check_weights()
+{
+  void *rq = policy_cfs.init();
+  TCB *normal = new_thread(1, 0), *heavy = new_thread(2, -5), *light = new_thread(3, 5);
+  char detail[128];
+  int i;
+
+  for (i = 0; i < 100; i++) {
+    policy_cfs.on_tick(rq, normal, 1);
+    policy_cfs.on_tick(rq, heavy, 1);
+    policy_cfs.on_tick(rq, light, 1);
+  }
+  snprintf(detail, sizeof(detail), "vruntime after 100 ticks: nice 0 %d, nice -5 %d, nice 5 %d", normal->vruntime,
+           heavy->vruntime, light->vruntime);
+  check("weighted vruntime", normal->vruntime == 100 && heavy->vruntime == 100 * 1024 / 3121 &&
+        light->vruntime == 100 * 1024 / 335, detail);
+}
+
+
+/* A thread that ran for a long time, and one that slept through it with no run time */
+static void check_sleeper()
+{
+  void *rq = policy_cfs.init();
+  TCB *busy = new_thread(1, 0), *sleeper = new_thread(2, 0), *first, *second;
+  char detail[128];
+  int i;
+
+  policy_cfs.enqueue(rq, busy);
+  first = policy_cfs.pick_next(rq);
+  for (i = 0; i < 1000; i++) policy_cfs.on_tick(rq, busy, 1);
+  policy_cfs.enqueue(rq, busy);
+  policy_cfs.on_wake(rq, sleeper);
+  second = policy_cfs.pick_next(rq);
+  snprintf(detail, sizeof(detail), "busy %d, woken at %d, first %d then %d", busy->vruntime, sleeper->vruntime,
+           first->tid, second->tid);
+  //Ahead of the busy one, but by no more than a latency period: it can not keep the CPU
+  check("sleeper credit", first == busy && second == sleeper && sleeper->vruntime < busy->vruntime &&
+        sleeper->vruntime >= busy->vruntime - QUANTUM_TICKS, detail);
+}
+
+
+int main(int argc, char *argv[])
+{
+  check_weights();
+  check_sleeper();
+  return failures > 0;
+}
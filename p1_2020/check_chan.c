@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mythread.h"
+
+/* Behaviour checks of the channels (see chan.c): what is left to receive after a close
+   and what a send on a closed channel does, a sender blocked on a full channel or until
+   a receiver takes its message, the operation a select does when several are ready,
+   its timeout and the sums of many senders and receivers on one channel. Run once with
+   1 worker and once with CHECK_WORKERS, each run in its own process since the library
+   ends the process when the last thread finishes.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_chan [policy] */
+
+#define CHECK_WORKERS 4
+#define CHECK_THREADS 4
+#define CHECK_MESSAGES 20000
+#define CHECK_CAPACITY 2
+#define CHECK_TIMEOUT 60
+/* Timed waits, and how long a blocked sender is given to show it is not blocked */
+#define CHECK_WAIT_NS 20000000LL
+
+static const char *policy = "rrs";
+static int workers;
+static int result_fd;
+static int failures = 0;
+
+static mythread_chan_t *chan;
+static int sent;
+static long sum;
+
+
+static long long now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void check(const char *name, int ok, const char *detail)
+{
+  dprintf(result_fd, "%-4s %-6s workers %d %-22s %s\n", ok ? "ok" : "FAIL", policy, workers, name, detail);
+  if (!ok) failures++;
+}
+
+static mythread_chan_t* new_chan(int capacity)
+{
+  mythread_chan_t *ch = mythread_chan_new(capacity);
+
+  if (ch == NULL) {
+    dprintf(result_fd, "FAIL %-6s workers %d mythread_chan_new\n", policy, workers);
+    exit(1);
+  }
+  return ch;
+}
+
+static int spawn(void *(*fn)(void *), void *arg)
+{
+  int tid = mythread_spawn(fn, arg, NULL);
+
+  if (tid < 0) {
+    dprintf(result_fd, "FAIL %-6s workers %d mythread_spawn %d\n", policy, workers, tid);
+    exit(1);
+  }
+  return tid;
+}
+
+static int sent_so_far()
+{
+  return __atomic_load_n(&sent, __ATOMIC_SEQ_CST);
+}
+
+
+static void check_closed()
+{
+  struct mythread_chan_op op;
+  char detail[128];
+  void *msg;
+  long i, got = 0, in_order = 1;
+  int after, send_ret, select_ret;
+
+  chan = new_chan(CHECK_CAPACITY + 1);
+  for (i = 1; i <= CHECK_CAPACITY + 1; i++) mythread_chan_send(chan, (void *) i);
+  mythread_chan_close(chan);
+  send_ret = mythread_chan_send(chan, (void *) 0);
+  //What was sent before the close is still received, in order
+  while (mythread_chan_recv(chan, &msg) == 0)
+    if ((long) msg != ++got) in_order = 0;
+  after = msg == NULL && mythread_chan_recv(chan, &msg) == -1;
+  op.chan = chan;
+  op.send = 0;
+  select_ret = mythread_chan_select(&op, 1, -1);
+  snprintf(detail, sizeof(detail), "send %d, %ld of %d received%s, select %d closed %d", send_ret, got,
+           CHECK_CAPACITY + 1, in_order ? "" : " out of order", select_ret, op.closed);
+  check("closed channel", send_ret == -1 && got == CHECK_CAPACITY + 1 && in_order && after &&
+        select_ret == 0 && op.closed, detail);
+  mythread_chan_free(chan);
+}
+
+
+/* Sends 1..n on chan, counting the sends that returned */
+static void *sender(void *arg)
+{
+  long i, n = (long) arg;
+
+  for (i = 1; i <= n; i++) {
+    if (mythread_chan_send(chan, (void *) i) < 0) return (void *) i;
+    __atomic_add_fetch(&sent, 1, __ATOMIC_SEQ_CST);
+  }
+  return NULL;
+}
+
+static void check_bounded()
+{
+  void *msg, *ret = (void *) -1;
+  char detail[128];
+  long i, in_order = 1;
+  int tid, full, after_recv;
+
+  chan = new_chan(CHECK_CAPACITY);
+  sent = 0;
+  tid = spawn(sender, (void *) (CHECK_CAPACITY + 2L));
+  //It fills the channel, then blocks
+  mythread_sleep(CHECK_WAIT_NS);
+  full = sent_so_far();
+  mythread_chan_recv(chan, &msg);
+  if ((long) msg != 1) in_order = 0;
+  mythread_sleep(CHECK_WAIT_NS);
+  after_recv = sent_so_far();
+  for (i = 2; i <= CHECK_CAPACITY + 2; i++) {
+    mythread_chan_recv(chan, &msg);
+    if ((long) msg != i) in_order = 0;
+  }
+  mythread_join(tid, &ret);
+  snprintf(detail, sizeof(detail), "%d sent when full, %d after a recv%s", full, after_recv,
+           in_order ? "" : ", out of order");
+  check("bounded send blocks", full == CHECK_CAPACITY && after_recv == CHECK_CAPACITY + 1 && in_order &&
+        ret == NULL, detail);
+  mythread_chan_free(chan);
+}
+
+static void check_unbuffered()
+{
+  void *msg = NULL, *ret = (void *) -1;
+  char detail[64];
+  int tid, before;
+
+  chan = new_chan(0);
+  sent = 0;
+  tid = spawn(sender, (void *) 1L);
+  //No room at all: the send returns once the message is taken
+  mythread_sleep(CHECK_WAIT_NS);
+  before = sent_so_far();
+  mythread_chan_recv(chan, &msg);
+  mythread_join(tid, &ret);
+  snprintf(detail, sizeof(detail), "%d sent before the recv, got %ld", before, (long) msg);
+  check("unbuffered rendezvous", before == 0 && (long) msg == 1 && sent_so_far() == 1 && ret == NULL, detail);
+  mythread_chan_free(chan);
+}
+
+
+/* Index of the select over ops, -2 if it did not take msg from its channel */
+static int select_ready(struct mythread_chan_op *ops, int n, void *msg)
+{
+  int i = mythread_chan_select(ops, n, 0);
+
+  if (i >= 0 && !ops[i].send && !ops[i].closed && ops[i].msg != msg) return -2;
+  return i;
+}
+
+static void check_select_ready()
+{
+  mythread_chan_t *chans[4];
+  struct mythread_chan_op ops[3];
+  char detail[128];
+  void *msg;
+  int i, first, second, all, send, closed;
+
+  for (i = 0; i < 4; i++) chans[i] = new_chan(1);
+  for (i = 0; i < 3; i++) {
+    ops[i].chan = chans[i];
+    ops[i].send = 0;
+  }
+  //1 and 2 ready: the first of them, and the other one is left
+  mythread_chan_send(chans[1], (void *) 1L);
+  mythread_chan_send(chans[2], (void *) 2L);
+  first = select_ready(ops, 3, (void *) 1L);
+  second = select_ready(ops, 3, (void *) 2L);
+  //0 ready too: it goes first
+  mythread_chan_send(chans[0], (void *) 0L);
+  mythread_chan_send(chans[2], (void *) 2L);
+  all = select_ready(ops, 3, (void *) 0L);
+  mythread_chan_recv(chans[2], &msg);
+  //A send with room, after a recv with nothing
+  ops[1].chan = chans[3];
+  ops[1].send = 1;
+  ops[1].msg = (void *) 3L;
+  send = select_ready(ops, 2, NULL);
+  //A closed channel is always ready
+  mythread_chan_close(chans[1]);
+  ops[1].chan = chans[1];
+  ops[1].send = 0;
+  closed = select_ready(ops, 2, NULL);
+
+  snprintf(detail, sizeof(detail), "1 2 ready %d then %d, 0 1 2 ready %d, send %d, closed %d", first, second,
+           all, send, closed);
+  check("select first ready", first == 1 && second == 2 && all == 0 && send == 1 && closed == 1 &&
+        ops[1].closed, detail);
+  for (i = 0; i < 4; i++) mythread_chan_free(chans[i]);
+}
+
+
+static void *late_sender(void *arg)
+{
+  mythread_sleep(CHECK_WAIT_NS);
+  mythread_chan_send(chan, arg);
+  return NULL;
+}
+
+static void check_select_wait()
+{
+  mythread_chan_t *empty = new_chan(0);
+  struct mythread_chan_op ops[2];
+  long long start, elapsed;
+  char detail[128];
+  int tid, timed_out, woken;
+
+  chan = new_chan(0);
+  ops[0].chan = empty;
+  ops[0].send = 0;
+  ops[1].chan = chan;
+  ops[1].send = 0;
+  start = now_ns();
+  timed_out = mythread_chan_select(ops, 2, CHECK_WAIT_NS);
+  elapsed = now_ns() - start;
+  //Parked on both, woken by a send on the second one
+  tid = spawn(late_sender, (void *) 7L);
+  woken = mythread_chan_select(ops, 2, -1);
+  mythread_join(tid, NULL);
+  snprintf(detail, sizeof(detail), "timeout %d after %.1f ms, woken %d with %ld", timed_out, elapsed / 1e6,
+           woken, (long) ops[1].msg);
+  check("select timeout, wake", timed_out == -1 && elapsed >= CHECK_WAIT_NS && woken == 1 &&
+        (long) ops[1].msg == 7 && mythread_chan_select(ops, 2, 0) == -1, detail);
+  mythread_chan_free(empty);
+  mythread_chan_free(chan);
+}
+
+
+/* Receives until the channel is closed */
+static void *receiver(void *arg)
+{
+  void *msg;
+
+  while (mythread_chan_recv(chan, &msg) == 0) __atomic_add_fetch(&sum, (long) msg, __ATOMIC_SEQ_CST);
+  return NULL;
+}
+
+static void check_contended()
+{
+  int senders[CHECK_THREADS], receivers[CHECK_THREADS];
+  long expected = CHECK_THREADS * ((long) CHECK_MESSAGES * (CHECK_MESSAGES + 1) / 2);
+  char detail[128];
+  int i;
+
+  chan = new_chan(CHECK_CAPACITY);
+  sent = 0;
+  sum = 0;
+  for (i = 0; i < CHECK_THREADS; i++) receivers[i] = spawn(receiver, NULL);
+  for (i = 0; i < CHECK_THREADS; i++) senders[i] = spawn(sender, (void *) (long) CHECK_MESSAGES);
+  for (i = 0; i < CHECK_THREADS; i++) mythread_join(senders[i], NULL);
+  mythread_chan_close(chan);
+  for (i = 0; i < CHECK_THREADS; i++) mythread_join(receivers[i], NULL);
+  snprintf(detail, sizeof(detail), "sum %ld of %ld, %d sent", sum, expected, sent);
+  check("many to many", sum == expected && sent == CHECK_THREADS * CHECK_MESSAGES, detail);
+  mythread_chan_free(chan);
+}
+
+
+/* Body of the child process */
+static void run_checks()
+{
+  int devnull = open("/dev/null", O_WRONLY);
+
+  /* The library messages are not part of the results */
+  dup2(devnull, STDOUT_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  alarm(CHECK_TIMEOUT);
+  mythread_set_workers(workers);
+  mythread_set_policy(policy);
+
+  check_closed();
+  check_bounded();
+  check_unbuffered();
+  check_select_ready();
+  check_select_wait();
+  check_contended();
+  exit(failures > 0);
+}
+
+/* Returns 1 if a check failed */
+static int run(int n)
+{
+  char buf[1024];
+  int fds[2], len, status;
+  pid_t pid;
+
+  workers = n;
+  if (pipe(fds) == -1)
+  {
+    perror("*** ERROR: pipe");
+    exit(-1);
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1)
+  {
+    perror("*** ERROR: fork");
+    exit(-1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    result_fd = fds[1];
+    run_checks();
+  }
+  close(fds[1]);
+  while ((len = read(fds[0], buf, sizeof(buf))) > 0) fwrite(buf, 1, len, stdout);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status)) printf("FAIL %-6s workers %d killed by signal %d\n", policy, n, WTERMSIG(status));
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int failed;
+
+  if (argc > 1) policy = argv[1];
+  if (mythread_set_policy(policy) < 0)
+  {
+    fprintf(stderr, "*** ERROR: unknown scheduling policy %s\n", policy);
+    exit(-1);
+  }
+  failed = run(1);
+  failed |= run(CHECK_WORKERS);
+  return failed;
+}
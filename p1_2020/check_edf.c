@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "interrupt.h"
+
+/* Checks of the edf policy, driving its run queue directly with TCBs that never run, on
+   the virtual clock: admission control rejects a total density over one CPU, the earliest
+   deadline runs first, and a periodic thread out of budget is throttled until its next
+   release, where it gets a new job. Single threaded, no interrupts.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_edf */
+
+static int failures = 0;
+
+
+static void check(const char *name, int ok, const char *detail)
+{
+  printf("%-4s %-6s %-22s %s\n", ok ? "ok" : "FAIL", "edf", name, detail);
+  if (!ok) failures++;
+}
+
+/* A ready thread, as mythread_create_deadline() (priority REALTIME) or mythread_create()
+   leave it */
+static TCB *new_thread(int tid, int priority, int runtime, int deadline, int period)
+{
+  TCB *t = calloc(1, sizeof(TCB));
+
+  if (t == NULL)
+  {
+    perror("*** ERROR: calloc");
+    exit(-1);
+  }
+  t->tid = tid;
+  t->state = INIT;
+  t->priority = priority;
+  t->ticks = QUANTUM_TICKS;
+  t->level = -1;
+  t->rt.runtime = runtime;
+  t->rt.deadline = deadline;
+  t->rt.period = period;
+  t->rt.abs_deadline = -1;
+  return t;
+}
+
+/* Current tick of the timer wheel, the clock of the deadlines */
+static long now()
+{
+  return clock_now() / tick_length();
+}
+
+
+static void check_admission()
+{
+  struct rt_params big = { .runtime = 6, .deadline = 10, .period = 10 };
+  struct rt_params rest = { .runtime = 4, .deadline = 10, .period = 10 };
+  char detail[128];
+  int first, over, full, single, after;
+
+  first = policy_edf.admit(big.runtime, big.deadline, big.period);
+  over = policy_edf.admit(5, 10, 10);
+  full = policy_edf.admit(rest.runtime, rest.deadline, rest.period);
+  //Any more is too much, even a single job
+  single = policy_edf.admit(1, 100, 0);
+  policy_edf.leave(&big);
+  after = policy_edf.admit(5, 10, 10);
+  policy_edf.leave(&rest);
+  policy_edf.leave(&(struct rt_params) { .runtime = 5, .deadline = 10, .period = 10 });
+  snprintf(detail, sizeof(detail), "60%% %d, +50%% %d, +40%% %d, +1%% %d, 50%% after 60%% left %d", first, over,
+           full, single, after);
+  check("admission", first == 0 && over == -1 && full == 0 && single == -1 && after == 0, detail);
+}
+
+
+static void check_order()
+{
+  void *rq = policy_edf.init();
+  TCB *late = new_thread(1, REALTIME, 5, 50, 0), *early = new_thread(2, REALTIME, 5, 20, 0);
+  TCB *high = new_thread(3, HIGH_PRIORITY, 0, 0, 0), *a, *b, *c;
+  char detail[128];
+
+  policy_edf.enqueue(rq, high);
+  policy_edf.enqueue(rq, late);
+  policy_edf.enqueue(rq, early);
+  a = policy_edf.pick_next(rq);
+  b = policy_edf.pick_next(rq);
+  c = policy_edf.pick_next(rq);
+  snprintf(detail, sizeof(detail), "picked %d %d %d", a->tid, b->tid, c->tid);
+  check("earliest deadline first", a == early && b == late && c == high, detail);
+}
+
+
+/* runtime 3 every 10 ticks, alone */
+static void check_throttle()
+{
+  void *rq = policy_edf.init();
+  TCB *t = new_thread(1, REALTIME, 3, 10, 10);
+  char detail[128];
+  int early = 0, preempt;
+  long start, until, release, deadline;
+
+  start = now();
+  policy_edf.enqueue(rq, t);
+  policy_edf.pick_next(rq);
+  //Its budget runs out at the third tick
+  run_virtual(tick_length());
+  early |= policy_edf.on_tick(rq, t, 1);
+  run_virtual(tick_length());
+  early |= policy_edf.on_tick(rq, t, 1);
+  run_virtual(tick_length());
+  preempt = policy_edf.on_tick(rq, t, 1);
+  until = policy_edf.throttle(rq, t);
+  //Queued again by the timer wheel at its next release
+  run_virtual((until - now()) * tick_length());
+  policy_edf.enqueue(rq, t);
+  release = t->rt.release - start;
+  deadline = t->rt.abs_deadline - start;
+  snprintf(detail, sizeof(detail), "preempt %d then %d, until %ld, job %ld from %ld to %ld, budget %d, misses %ld",
+           early, preempt, until - start, t->rt.stats.jobs, release, deadline, t->rt.budget, t->rt.stats.misses);
+  check("throttle until release", !early && preempt && until - start == 10 && t->rt.stats.jobs == 2 &&
+        release == 10 && deadline == 20 && t->rt.budget == 3 && t->rt.stats.misses == 0, detail);
+}
+
+
+int main(int argc, char *argv[])
+{
+  //The deadlines only move when the check advances the clock
+  set_virtual_clock();
+  check_admission();
+  check_order();
+  check_throttle();
+  return failures > 0;
+}
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mythread.h"
+
+/* Behaviour checks of mythread_spawn() and mythread_join(): the values returned by the
+   bodies, with the slots reused round after round, a join after the thread finished, a
+   thread that calls mythread_exit(), a tid joined again once its slot went to a new
+   thread, and the errors: a thread that is not joinable
+   (-1), a second joiner (-2), the caller itself (-3) and invalid attributes. Run once
+   with 1 worker and once with CHECK_WORKERS, each run in its own process since the
+   library ends the process when the last thread finishes.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_join [policy] */
+
+#define CHECK_WORKERS 4
+#define CHECK_THREADS 32
+#define CHECK_ROUNDS 50
+#define CHECK_TIMEOUT 60
+/* Long enough for a thread to finish, or to park */
+#define CHECK_WAIT_NS 20000000LL
+
+static const char *policy = "rrs";
+static int workers;
+static int result_fd;
+static int failures = 0;
+
+static int target;
+
+
+static void check(const char *name, int ok, const char *detail)
+{
+  dprintf(result_fd, "%-4s %-6s workers %d %-22s %s\n", ok ? "ok" : "FAIL", policy, workers, name, detail);
+  if (!ok) failures++;
+}
+
+static int spawn(void *(*fn)(void *), void *arg)
+{
+  int tid = mythread_spawn(fn, arg, NULL);
+
+  if (tid < 0) {
+    dprintf(result_fd, "FAIL %-6s workers %d mythread_spawn %d\n", policy, workers, tid);
+    exit(1);
+  }
+  return tid;
+}
+
+
+/* Some of them run long enough to be preempted, some of them sleep */
+static void *square(void *arg)
+{
+  volatile long i;
+  long x = (long) arg;
+
+  if (x % 3 == 0) for (i = 0; i < 200000; i++);
+  if (x % 5 == 0) mythread_sleep(1000000);
+  return (void *) (x * x);
+}
+
+static void check_values()
+{
+  int tids[CHECK_THREADS];
+  char detail[128];
+  long x, round, bad = 0;
+  int i, failed_join = 0;
+  void *ret;
+
+  for (round = 0; round < CHECK_ROUNDS; round++) {
+    for (i = 0; i < CHECK_THREADS; i++) tids[i] = spawn(square, (void *) (round * CHECK_THREADS + i));
+    //In the reverse order, so most of them are joined after they finished
+    for (i = CHECK_THREADS - 1; i >= 0; i--) {
+      x = round * CHECK_THREADS + i;
+      if (mythread_join(tids[i], &ret) != 0) failed_join++;
+      else if ((long) ret != x * x) bad++;
+    }
+  }
+  snprintf(detail, sizeof(detail), "%d threads, %d joins failed, %ld wrong values", CHECK_ROUNDS * CHECK_THREADS,
+           failed_join, bad);
+  check("join return values", failed_join == 0 && bad == 0, detail);
+}
+
+
+static void *quick(void *arg)
+{
+  return arg;
+}
+
+static void *exiter(void *arg)
+{
+  mythread_exit();
+  return arg;
+}
+
+static void check_exited()
+{
+  struct mythread_stats stats;
+  void *ret = NULL, *exit_ret = (void *) 1;
+  char detail[128];
+  int tid, joined, stats_before, again, exit_tid;
+
+  tid = spawn(quick, (void *) 42L);
+  exit_tid = spawn(exiter, (void *) 1L);
+  mythread_sleep(CHECK_WAIT_NS);
+  //Finished, its TCB kept until the join
+  stats_before = mythread_stats(tid, &stats);
+  joined = mythread_join(tid, &ret);
+  again = mythread_join(tid, NULL);
+  mythread_join(exit_tid, &exit_ret);
+  snprintf(detail, sizeof(detail), "stats %d, join %d with %ld, again %d, after exit %ld", stats_before, joined,
+           (long) ret, again, (long) exit_ret);
+  check("join after the exit", stats_before == 0 && joined == 0 && (long) ret == 42 && again == -1 &&
+        exit_ret == NULL, detail);
+}
+
+
+static void not_joinable(int arg)
+{
+  mythread_sleep(3 * CHECK_WAIT_NS);
+  mythread_exit();
+}
+
+static void *sleeper(void *arg)
+{
+  mythread_sleep(3 * CHECK_WAIT_NS);
+  return arg;
+}
+
+/* Joins target, parked until it finishes */
+static void *joiner(void *arg)
+{
+  void *ret = NULL;
+
+  if (mythread_join(target, &ret) != 0) return (void *) -1L;
+  return ret;
+}
+
+static void *self_joiner(void *arg)
+{
+  return (void *) (long) mythread_join(mythread_gettid(), NULL);
+}
+
+static void check_errors()
+{
+  void *first = NULL, *self = NULL;
+  char detail[128];
+  int tid, joiner_tid, self_tid, plain, second, own;
+
+  //Created by mythread_create(), running
+  tid = mythread_create(not_joinable, LOW_PRIORITY, 0);
+  plain = tid < 0 ? tid : mythread_join(tid, NULL);
+
+  target = spawn(sleeper, (void *) 7L);
+  joiner_tid = spawn(joiner, NULL);
+  mythread_sleep(CHECK_WAIT_NS);
+  second = mythread_join(target, NULL);
+  mythread_join(joiner_tid, &first);
+
+  self_tid = spawn(self_joiner, NULL);
+  mythread_join(self_tid, &self);
+  own = mythread_join(mythread_gettid(), NULL);
+
+  snprintf(detail, sizeof(detail), "not joinable %d, second joiner %d, first got %ld, self %ld %d", plain,
+           second, (long) first, (long) self, own);
+  check("join errors", plain == -1 && second == -2 && (long) first == 7 && (long) self == -3 && own == -3,
+        detail);
+}
+
+
+/* The released tid must not reach the thread that took its slot */
+static void check_reused()
+{
+  void *ret = NULL;
+  char detail[128];
+  int tid, joined, reused, again, twice, last;
+
+  tid = spawn(quick, (void *) 1L);
+  mythread_sleep(CHECK_WAIT_NS);
+  joined = mythread_join(tid, NULL);
+  //The slot just released is the first one taken
+  reused = spawn(sleeper, (void *) 9L);
+  again = mythread_join(tid, NULL);
+  twice = mythread_join(tid, NULL);
+  last = mythread_join(reused, &ret);
+  snprintf(detail, sizeof(detail), "join %d, tid %d then %d, again %d %d, new one %d with %ld", joined, tid,
+           reused, again, twice, last, (long) ret);
+  check("join a reused tid", joined == 0 && reused != tid && again == -1 && twice == -1 && last == 0 &&
+        (long) ret == 9, detail);
+}
+
+
+static void check_attributes()
+{
+  mythread_attr_t attr;
+  char detail[128];
+  int high, bad_priority, bad_seconds, system;
+  void *ret = NULL;
+
+  mythread_attr_init(&attr);
+  attr.priority = HIGH_PRIORITY;
+  attr.stack_size = 64 * 1024;
+  high = mythread_spawn(quick, (void *) 5L, &attr);
+  if (high >= 0 && mythread_join(high, &ret) != 0) ret = NULL;
+  attr.priority = MAX_PRIORITY + 10;
+  bad_priority = mythread_spawn(quick, NULL, &attr);
+  attr.priority = SYSTEM;
+  system = mythread_spawn(quick, NULL, &attr);
+  attr.priority = LOW_PRIORITY;
+  attr.seconds = -1;
+  bad_seconds = mythread_spawn(quick, NULL, &attr);
+  snprintf(detail, sizeof(detail), "high %d with %ld, priority %d, system %d, seconds %d", high >= 0, (long) ret,
+           bad_priority, system, bad_seconds);
+  check("spawn attributes", high >= 0 && (long) ret == 5 && bad_priority == -3 && system == -2 &&
+        bad_seconds == -3, detail);
+}
+
+
+/* Body of the child process */
+static void run_checks()
+{
+  int devnull = open("/dev/null", O_WRONLY);
+
+  /* The library messages are not part of the results */
+  dup2(devnull, STDOUT_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  alarm(CHECK_TIMEOUT);
+  mythread_set_workers(workers);
+  mythread_set_policy(policy);
+
+  check_values();
+  check_exited();
+  check_errors();
+  check_reused();
+  check_attributes();
+  exit(failures > 0);
+}
+
+/* Returns 1 if a check failed */
+static int run(int n)
+{
+  char buf[1024];
+  int fds[2], len, status;
+  pid_t pid;
+
+  workers = n;
+  if (pipe(fds) == -1)
+  {
+    perror("*** ERROR: pipe");
+    exit(-1);
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1)
+  {
+    perror("*** ERROR: fork");
+    exit(-1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    result_fd = fds[1];
+    run_checks();
+  }
+  close(fds[1]);
+  while ((len = read(fds[0], buf, sizeof(buf))) > 0) fwrite(buf, 1, len, stdout);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status)) printf("FAIL %-6s workers %d killed by signal %d\n", policy, n, WTERMSIG(status));
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int failed;
+
+  if (argc > 1) policy = argv[1];
+  if (mythread_set_policy(policy) < 0)
+  {
+    fprintf(stderr, "*** ERROR: unknown scheduling policy %s\n", policy);
+    exit(-1);
+  }
+  failed = run(1);
+  failed |= run(CHECK_WORKERS);
+  return failed;
+}
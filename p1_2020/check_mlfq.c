@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "interrupt.h"
+#include "trace.h"
+
+/* Checks of the mlfq policy, driving its run queue directly with TCBs that never run:
+   a thread that uses its whole slice goes one level down, only a wait for the disk moves
+   it up, and a thread that waited more than STARVATION ticks at a lower level is boosted
+   to level 0. Single threaded, no interrupts.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_mlfq */
+
+static int failures = 0;
+
+
+static void check(const char *name, int ok, const char *detail)
+{
+  printf("%-4s %-6s %-22s %s\n", ok ? "ok" : "FAIL", "mlfq", name, detail);
+  if (!ok) failures++;
+}
+
+/* A ready thread, as mythread_create() leaves it. level -1 lets the priority choose it */
+static TCB *new_thread(int tid, int priority, int level)
+{
+  TCB *t = calloc(1, sizeof(TCB));
+
+  if (t == NULL)
+  {
+    perror("*** ERROR: calloc");
+    exit(-1);
+  }
+  t->tid = tid;
+  t->state = INIT;
+  t->priority = priority;
+  t->ticks = QUANTUM_TICKS;
+  t->level = level;
+  return t;
+}
+
+/* ticks clock ticks while t runs, its counters updated first as timer_interrupt() does.
+   Returns the last decision of the policy */
+static int run(void *rq, TCB *t, int ticks)
+{
+  int preempt = 0;
+
+  while (ticks-- > 0) {
+    t->ticks--;
+    preempt = policy_mlfq.on_tick(rq, t, 1);
+  }
+  return preempt;
+}
+
+
+static void check_demotion()
+{
+  void *rq = policy_mlfq.init();
+  TCB *t = new_thread(1, LOW_PRIORITY, -1), *picked;
+  char detail[128];
+  int first, slice, after_slice, after_two;
+
+  policy_mlfq.enqueue(rq, t);
+  picked = policy_mlfq.pick_next(rq);
+  first = t->level;
+  slice = t->ticks;
+  //Alone: it keeps the CPU with a new, longer slice
+  run(rq, t, slice);
+  after_slice = t->level;
+  run(rq, t, t->ticks);
+  after_two = t->level;
+  snprintf(detail, sizeof(detail), "level %d, slice %d, then level %d and %d", first, slice, after_slice,
+           after_two);
+  check("demotion", picked == t && first == 1 && after_slice == 2 && after_two == 3, detail);
+}
+
+
+static void check_promotion()
+{
+  void *rq = policy_mlfq.init();
+  TCB *t = new_thread(1, LOW_PRIORITY, 2);
+  char detail[128];
+  int timer, sync, io;
+
+  policy_mlfq.on_block(rq, t, TRACE_TIMER);
+  timer = t->level;
+  policy_mlfq.on_block(rq, t, TRACE_SYNC);
+  sync = t->level;
+  policy_mlfq.on_block(rq, t, TRACE_IO);
+  io = t->level;
+  snprintf(detail, sizeof(detail), "from level 2: sleep %d, lock %d, disk %d", timer, sync, io);
+  check("promotion on disk only", timer == 2 && sync == 2 && io == 1, detail);
+}
+
+
+/* A CPU bound thread at the lowest level, while a high priority one keeps the CPU */
+static void check_boost()
+{
+  void *rq = policy_mlfq.init();
+  TCB *starved = new_thread(1, LOW_PRIORITY, 3), *hog = new_thread(2, HIGH_PRIORITY, -1), *next;
+  char detail[128];
+  int before, preempt;
+
+  policy_mlfq.enqueue(rq, starved);
+  policy_mlfq.enqueue(rq, hog);
+  next = policy_mlfq.pick_next(rq);
+  run(rq, hog, STARVATION);
+  before = starved->level;
+  preempt = run(rq, hog, 1);
+  snprintf(detail, sizeof(detail), "picked %d, level %d after %d ticks, %d after one more, preempt %d", next->tid,
+           before, STARVATION, starved->level, preempt);
+  //The hog went down meanwhile, the boosted thread is above it now
+  check("boost after STARVATION", next == hog && before == 3 && starved->level == 0 && preempt == 1 &&
+        policy_mlfq.pick_next(rq) == starved, detail);
+}
+
+
+int main(int argc, char *argv[])
+{
+  check_demotion();
+  check_promotion();
+  check_boost();
+  return failures > 0;
+}
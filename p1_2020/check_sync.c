@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mythread.h"
+
+/* Behaviour checks of the mutexes, condition variables and semaphores (see sync.c):
+   exclusion and counts under contention, the handoff to the waiters, broadcast and
+   signal, the limit of a semaphore and the timed waits. Run once with 1 worker and
+   once with CHECK_WORKERS, each run in its own process since the library ends the
+   process when the last thread finishes.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_sync [policy] */
+
+#define CHECK_WORKERS 4
+#define CHECK_THREADS 8
+#define CHECK_ITERATIONS 20000
+#define CHECK_SEM_UNITS 3
+#define CHECK_TIMEOUT 60
+/* Timed waits, shorter than the checks around them */
+#define CHECK_WAIT_NS 20000000LL
+
+static const char *policy = "rrs";
+static int workers;
+static int result_fd;
+static int failures = 0;
+
+static mythread_mutex_t mutex;
+static mythread_cond_t cond;
+static mythread_sem_t sem;
+static long counter;
+static int inside, max_inside;
+static int waiting, wakeups, woken, go;
+
+
+static long long now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void check(const char *name, int ok, const char *detail)
+{
+  dprintf(result_fd, "%-4s %-6s workers %d %-22s %s\n", ok ? "ok" : "FAIL", policy, workers, name, detail);
+  if (!ok) failures++;
+}
+
+/* Counts the threads inside a critical section, and the most there ever were */
+static void enter()
+{
+  int n = __atomic_add_fetch(&inside, 1, __ATOMIC_SEQ_CST);
+  int max = __atomic_load_n(&max_inside, __ATOMIC_RELAXED);
+
+  while (n > max && !__atomic_compare_exchange_n(&max_inside, &max, n, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+static void leave()
+{
+  __atomic_sub_fetch(&inside, 1, __ATOMIC_SEQ_CST);
+}
+
+static void spawn_all(void *(*fn)(void *), int n, int *tids)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    tids[i] = mythread_spawn(fn, NULL, NULL);
+    if (tids[i] < 0) {
+      dprintf(result_fd, "FAIL %-6s workers %d mythread_spawn %d\n", policy, workers, tids[i]);
+      exit(1);
+    }
+  }
+}
+
+static void join_all(int n, int *tids)
+{
+  int i;
+
+  for (i = 0; i < n; i++) mythread_join(tids[i], NULL);
+}
+
+
+/* Read, then write later: a lost update if two threads are ever inside at once. Some
+   iterations take long enough to be preempted with the mutex held */
+static void *adder(void *arg)
+{
+  volatile int k;
+  long v;
+  int i;
+
+  for (i = 0; i < CHECK_ITERATIONS; i++) {
+    mythread_mutex_lock(&mutex);
+    enter();
+    v = counter;
+    if (i % 1000 == 0) for (k = 0; k < 100000; k++);
+    counter = v + 1;
+    leave();
+    mythread_mutex_unlock(&mutex);
+  }
+  return NULL;
+}
+
+static void check_mutex_count()
+{
+  int tids[CHECK_THREADS];
+  char detail[128];
+
+  counter = 0;
+  max_inside = 0;
+  spawn_all(adder, CHECK_THREADS, tids);
+  join_all(CHECK_THREADS, tids);
+  snprintf(detail, sizeof(detail), "count %ld of %d, at most %d inside", counter,
+           CHECK_THREADS * CHECK_ITERATIONS, max_inside);
+  check("mutex contended count", counter == CHECK_THREADS * CHECK_ITERATIONS && max_inside == 1, detail);
+}
+
+
+/* Takes the mutex held by the main thread: not the owner, it can not unlock it either */
+static void *other_locker(void *arg)
+{
+  long long start;
+  long ret;
+
+  if (mythread_mutex_trylock(&mutex) != -1) return (void *) 1;
+  if (mythread_mutex_unlock(&mutex) != -1) return (void *) 2;
+  start = now_ns();
+  ret = mythread_mutex_timedlock(&mutex, CHECK_WAIT_NS);
+  if (ret != -1 || now_ns() - start < CHECK_WAIT_NS) return (void *) 3;
+  //Handed over by the unlock of the main thread
+  if (mythread_mutex_lock(&mutex) != 0) return (void *) 4;
+  if (mythread_mutex_unlock(&mutex) != 0) return (void *) 5;
+  return NULL;
+}
+
+static void check_mutex_owner()
+{
+  void *ret = (void *) -1;
+  char detail[64];
+  int tid;
+
+  mythread_mutex_lock(&mutex);
+  tid = mythread_spawn(other_locker, NULL, NULL);
+  //Long enough for it to time out and to park again
+  mythread_sleep(3 * CHECK_WAIT_NS);
+  mythread_mutex_unlock(&mutex);
+  mythread_join(tid, &ret);
+  snprintf(detail, sizeof(detail), "step %ld", (long) ret);
+  check("mutex owner and timeout", ret == NULL && mythread_mutex_unlock(&mutex) == -1, detail);
+}
+
+
+static void *cond_waiter(void *arg)
+{
+  mythread_mutex_lock(&mutex);
+  waiting++;
+  while (!go) {
+    mythread_cond_wait(&cond, &mutex);
+    wakeups++;
+  }
+  woken++;
+  mythread_mutex_unlock(&mutex);
+  return NULL;
+}
+
+/* Waits until *count, protected by the mutex, reaches n */
+static void wait_for(int *count, int n)
+{
+  mythread_mutex_lock(&mutex);
+  while (*count < n) {
+    mythread_mutex_unlock(&mutex);
+    mythread_sleep(1000000);
+    mythread_mutex_lock(&mutex);
+  }
+  mythread_mutex_unlock(&mutex);
+}
+
+static void check_cond()
+{
+  int tids[CHECK_THREADS];
+  int after_signal, after_broadcast;
+  char detail[128];
+
+  waiting = wakeups = woken = go = 0;
+  spawn_all(cond_waiter, CHECK_THREADS, tids);
+  wait_for(&waiting, CHECK_THREADS);
+
+  //A signal with go still 0: exactly one wakes up, and waits again
+  mythread_mutex_lock(&mutex);
+  mythread_cond_signal(&cond);
+  mythread_mutex_unlock(&mutex);
+  wait_for(&wakeups, 1);
+  mythread_sleep(CHECK_WAIT_NS);
+  mythread_mutex_lock(&mutex);
+  after_signal = wakeups;
+  go = 1;
+  mythread_cond_broadcast(&cond);
+  mythread_mutex_unlock(&mutex);
+  join_all(CHECK_THREADS, tids);
+  after_broadcast = wakeups - after_signal;
+  snprintf(detail, sizeof(detail), "%d woken by the signal, %d of %d by the broadcast", after_signal,
+           after_broadcast, CHECK_THREADS);
+  check("cond signal, broadcast", after_signal == 1 && after_broadcast == CHECK_THREADS &&
+        woken == CHECK_THREADS, detail);
+}
+
+static void check_cond_timeout()
+{
+  long long start, elapsed;
+  char detail[64];
+  int ret, owned;
+
+  mythread_mutex_lock(&mutex);
+  start = now_ns();
+  ret = mythread_cond_timedwait(&cond, &mutex, CHECK_WAIT_NS);
+  elapsed = now_ns() - start;
+  //The mutex is held again after the timeout
+  owned = mythread_mutex_unlock(&mutex) == 0;
+  snprintf(detail, sizeof(detail), "returned %d after %.1f ms", ret, elapsed / 1e6);
+  check("cond timedwait", ret == -1 && elapsed >= CHECK_WAIT_NS && owned &&
+        mythread_cond_timedwait(&cond, &mutex, CHECK_WAIT_NS) == -2, detail);
+}
+
+
+static void *sem_user(void *arg)
+{
+  int i;
+
+  for (i = 0; i < 20; i++) {
+    mythread_sem_wait(&sem);
+    enter();
+    mythread_sleep(500000);
+    leave();
+    mythread_sem_post(&sem);
+  }
+  return NULL;
+}
+
+static void check_sem_limit()
+{
+  int tids[CHECK_THREADS];
+  char detail[128];
+
+  max_inside = 0;
+  mythread_sem_init(&sem, CHECK_SEM_UNITS);
+  spawn_all(sem_user, CHECK_THREADS, tids);
+  join_all(CHECK_THREADS, tids);
+  snprintf(detail, sizeof(detail), "at most %d inside, %d units left", max_inside, mythread_sem_getvalue(&sem));
+  check("sem limit", max_inside == CHECK_SEM_UNITS && mythread_sem_getvalue(&sem) == CHECK_SEM_UNITS, detail);
+  mythread_sem_destroy(&sem);
+}
+
+static void check_sem_timeout()
+{
+  long long start, elapsed;
+  char detail[64];
+  int ret, ok;
+
+  mythread_sem_init(&sem, 0);
+  ok = mythread_sem_trywait(&sem) == -1;
+  start = now_ns();
+  ret = mythread_sem_timedwait(&sem, CHECK_WAIT_NS);
+  elapsed = now_ns() - start;
+  mythread_sem_post(&sem);
+  ok = ok && mythread_sem_timedwait(&sem, 0) == 0 && mythread_sem_getvalue(&sem) == 0;
+  snprintf(detail, sizeof(detail), "returned %d after %.1f ms", ret, elapsed / 1e6);
+  check("sem timedwait", ok && ret == -1 && elapsed >= CHECK_WAIT_NS, detail);
+  mythread_sem_destroy(&sem);
+}
+
+
+/* Body of the child process */
+static void run_checks()
+{
+  int devnull = open("/dev/null", O_WRONLY);
+
+  /* The library messages are not part of the results */
+  dup2(devnull, STDOUT_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  alarm(CHECK_TIMEOUT);
+  mythread_set_workers(workers);
+  mythread_set_policy(policy);
+
+  mythread_mutex_init(&mutex);
+  mythread_cond_init(&cond);
+  check_mutex_count();
+  check_mutex_owner();
+  check_cond();
+  check_cond_timeout();
+  check_sem_limit();
+  check_sem_timeout();
+  exit(failures > 0);
+}
+
+/* Returns 1 if a check failed */
+static int run(int n)
+{
+  char buf[1024];
+  int fds[2], len, status;
+  pid_t pid;
+
+  workers = n;
+  if (pipe(fds) == -1)
+  {
+    perror("*** ERROR: pipe");
+    exit(-1);
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1)
+  {
+    perror("*** ERROR: fork");
+    exit(-1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    result_fd = fds[1];
+    run_checks();
+  }
+  close(fds[1]);
+  while ((len = read(fds[0], buf, sizeof(buf))) > 0) fwrite(buf, 1, len, stdout);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status)) printf("FAIL %-6s workers %d killed by signal %d\n", policy, n, WTERMSIG(status));
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int failed;
+
+  if (argc > 1) policy = argv[1];
+  if (mythread_set_policy(policy) < 0)
+  {
+    fprintf(stderr, "*** ERROR: unknown scheduling policy %s\n", policy);
+    exit(-1);
+  }
+  failed = run(1);
+  failed |= run(CHECK_WORKERS);
+  return failed;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "timer_wheel.h"
+
+/* Checks of the timing wheel, with expiries on both sides of every level boundary and
+   beyond the range of the wheel: one advance over all of them returns them in expiry
+   order, and advancing step by step fires each one at the first step that reaches it,
+   never before. Single threaded, the wheel alone.
+   It prints one line per check and exits with 1 if any of them failed.
+   Usage: check_wheel */
+
+#define RANGE (1L << (WHEEL_BITS * WHEEL_LEVELS))
+#define TIMERS (sizeof(expiries) / sizeof(expiries[0]))
+
+/* Not sorted, as they are added */
+static const long expiries[] = {
+  4097, 63, RANGE + 5, 1, 262144, 64, 4095, RANGE - 1, 65, 262143, 4096, 262145, 2, 64, RANGE, 130,
+};
+
+/* Where the step by step check stops, some of them right on an expiry */
+static const long steps[] = {
+  1, 2, 62, 64, 66, 1000, 4095, 4096, 4100, 262143, 262146, RANGE - 2, RANGE, RANGE + 100,
+};
+
+static int failures = 0;
+
+
+static void check(const char *name, int ok, const char *detail)
+{
+  printf("%-4s %-6s %-22s %s\n", ok ? "ok" : "FAIL", "wheel", name, detail);
+  if (!ok) failures++;
+}
+
+static void add_all(struct timer_wheel *w, struct wheel_timer *timers)
+{
+  unsigned int i;
+
+  wheel_init(w, 0);
+  for (i = 0; i < TIMERS; i++) {
+    wheel_timer_init(&timers[i], NULL);
+    wheel_add(w, &timers[i], expiries[i]);
+  }
+}
+
+
+static void check_one_advance()
+{
+  struct timer_wheel w;
+  struct wheel_timer timers[TIMERS], *t;
+  char detail[128];
+  long last = 0;
+  int fired = 0, unordered = 0;
+
+  add_all(&w, timers);
+  for (t = wheel_advance(&w, RANGE + 100); t != NULL; t = t->next) {
+    if (t->expires < last) unordered++;
+    last = t->expires;
+    fired++;
+  }
+  snprintf(detail, sizeof(detail), "%d of %d fired, %d out of order, %d left", fired, (int) TIMERS, unordered,
+           w.armed);
+  check("expiry order", fired == TIMERS && unordered == 0 && w.armed == 0, detail);
+}
+
+
+static void check_steps()
+{
+  struct timer_wheel w;
+  struct wheel_timer timers[TIMERS], *t;
+  char detail[128];
+  long prev = 0, next;
+  int fired = 0, early = 0, late = 0, wrong_next = 0;
+  unsigned int i, s;
+
+  add_all(&w, timers);
+  for (s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+    //Never after the first expiry still in the wheel
+    next = LONG_MAX;
+    for (i = 0; i < TIMERS; i++) if (wheel_pending(&timers[i]) && timers[i].expires < next) next = timers[i].expires;
+    if (wheel_next_event(&w) > next) wrong_next++;
+
+    for (t = wheel_advance(&w, steps[s]); t != NULL; t = t->next) {
+      if (t->expires > steps[s]) early++;
+      if (t->expires <= prev) late++;
+      fired++;
+    }
+    prev = steps[s];
+  }
+  snprintf(detail, sizeof(detail), "%d of %d fired, %d early, %d late, %d next events too late", fired,
+           (int) TIMERS, early, late, wrong_next);
+  check("fire at the first step", fired == TIMERS && early == 0 && late == 0 && wrong_next == 0, detail);
+}
+
+
+int main(int argc, char *argv[])
+{
+  check_one_advance();
+  check_steps();
+  return failures > 0;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+
+#include "context.h"
+
+/* First C code run by a context created with mctx_make() */
+static void mctx_start(mctx_t* ctx)
+{
+#ifdef MCTX_FAST
+  sigprocmask(SIG_SETMASK, &ctx->start_mask, NULL);
+#endif
+  ctx->fn(ctx->arg);
+  fprintf(stderr, "*** ERROR: context entry point returned\n");
+  exit(-1);
+}
+
+
+#ifdef MCTX_FAST
+
+/* mctx_swap(void** save_sp, void* load_sp): pushes the callee-saved registers,
+   stores the stack pointer in *save_sp, loads load_sp and pops the registers
+   of the other context.
+   mctx_trampoline: first return address of a new context, calls mctx_start(ctx)
+   with ctx and mctx_start taken from two callee-saved registers */
+void mctx_swap(void** save_sp, void* load_sp);
+void mctx_trampoline();
+
+#if defined(__x86_64__)
+
+/* Frame: fpu control word, mxcsr, r15, r14, r13, r12, rbx, rbp, return address */
+#define MCTX_FRAME_WORDS 9
+#define MCTX_REG_ARG 5 /* r12 */
+#define MCTX_REG_START 4 /* r13 */
+#define MCTX_REG_RET 8
+
+__asm__ (
+  ".text\n"
+  ".p2align 4\n"
+  ".type mctx_swap, @function\n"
+  "mctx_swap:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $16, %rsp\n"
+  "  stmxcsr 8(%rsp)\n"
+  "  fnstcw (%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr 8(%rsp)\n"
+  "  fldcw (%rsp)\n"
+  "  addq $16, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size mctx_swap, .-mctx_swap\n"
+  ".p2align 4\n"
+  ".type mctx_trampoline, @function\n"
+  "mctx_trampoline:\n"
+  "  movq %r12, %rdi\n"
+  "  callq *%r13\n"
+  "  ud2\n"
+  ".size mctx_trampoline, .-mctx_trampoline\n"
+);
+
+#elif defined(__aarch64__)
+
+/* Frame: x19-x28, x29, x30 (return address), d8-d15 */
+#define MCTX_FRAME_WORDS 22
+#define MCTX_REG_ARG 0 /* x19 */
+#define MCTX_REG_START 1 /* x20 */
+#define MCTX_REG_RET 11 /* x30 */
+
+__asm__ (
+  ".text\n"
+  ".p2align 4\n"
+  ".type mctx_swap, %function\n"
+  "mctx_swap:\n"
+  "  sub sp, sp, #176\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8, d9, [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mov x9, sp\n"
+  "  str x9, [x0]\n"
+  "  mov sp, x1\n"
+  "  ldp x19, x20, [sp, #0]\n"
+  "  ldp x21, x22, [sp, #16]\n"
+  "  ldp x23, x24, [sp, #32]\n"
+  "  ldp x25, x26, [sp, #48]\n"
+  "  ldp x27, x28, [sp, #64]\n"
+  "  ldp x29, x30, [sp, #80]\n"
+  "  ldp d8, d9, [sp, #96]\n"
+  "  ldp d10, d11, [sp, #112]\n"
+  "  ldp d12, d13, [sp, #128]\n"
+  "  ldp d14, d15, [sp, #144]\n"
+  "  add sp, sp, #176\n"
+  "  ret\n"
+  ".size mctx_swap, .-mctx_swap\n"
+  ".p2align 4\n"
+  ".type mctx_trampoline, %function\n"
+  "mctx_trampoline:\n"
+  "  mov x0, x19\n"
+  "  blr x20\n"
+  "  brk #0\n"
+  ".size mctx_trampoline, .-mctx_trampoline\n"
+);
+
+#endif
+
+
+void mctx_make(mctx_t* ctx, void* stack, size_t size, void (*fn)(void*), void* arg)
+{
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uintptr_t* frame;
+
+  ctx->fn = fn;
+  ctx->arg = arg;
+  sigprocmask(SIG_BLOCK, NULL, &ctx->start_mask);
+
+#if defined(__x86_64__)
+  /* After popping the frame the stack must be 16 byte aligned, as before a call */
+  frame = (uintptr_t*)(top - 16 - MCTX_FRAME_WORDS * sizeof(uintptr_t));
+  memset(frame, 0, MCTX_FRAME_WORDS * sizeof(uintptr_t));
+  frame[0] = 0x037F; /* Default x87 control word */
+  frame[1] = 0x1F80; /* Default mxcsr */
+#else
+  /* The frame is 176 bytes (22 words + padding) */
+  frame = (uintptr_t*)(top - 176);
+  memset(frame, 0, 176);
+#endif
+  frame[MCTX_REG_ARG] = (uintptr_t)ctx;
+  frame[MCTX_REG_START] = (uintptr_t)mctx_start;
+  frame[MCTX_REG_RET] = (uintptr_t)mctx_trampoline;
+  ctx->sp = frame;
+}
+
+
+int mctx_switch(mctx_t* from, mctx_t* to)
+{
+  mctx_swap(&from->sp, to->sp);
+  return 0;
+}
+
+
+int mctx_jump(mctx_t* to)
+{
+  void* discarded;
+  mctx_swap(&discarded, to->sp);
+  return -1;
+}
+
+#else /* ucontext fallback */
+
+/* makecontext only passes int arguments: the pointer is split in two halves */
+static void mctx_start_uc(unsigned int low, unsigned int high)
+{
+  mctx_start((mctx_t*)(((uintptr_t)high << 16 << 16) | low));
+}
+
+
+void mctx_make(mctx_t* ctx, void* stack, size_t size, void (*fn)(void*), void* arg)
+{
+  uintptr_t p = (uintptr_t)ctx;
+
+  ctx->fn = fn;
+  ctx->arg = arg;
+  if(getcontext(&ctx->uc) == -1)
+  {
+    perror("*** ERROR: getcontext in mctx_make");
+    exit(-1);
+  }
+  ctx->uc.uc_stack.ss_sp = stack;
+  ctx->uc.uc_stack.ss_size = size;
+  ctx->uc.uc_stack.ss_flags = 0;
+  ctx->uc.uc_link = NULL;
+  makecontext(&ctx->uc, (void (*)())mctx_start_uc, 2, (unsigned int)p, (unsigned int)(p >> 16 >> 16));
+}
+
+
+int mctx_switch(mctx_t* from, mctx_t* to)
+{
+  return swapcontext(&from->uc, &to->uc);
+}
+
+
+int mctx_jump(mctx_t* to)
+{
+  return setcontext(&to->uc);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include <stddef.h>
+#include <signal.h>
+#include <ucontext.h>
+
+/* Execution contexts of the threads.
+   On x86-64 and aarch64 the switch is hand written: it only saves the callee-saved
+   registers and the stack pointer, with no system call. Everywhere else (or when
+   MYTHREAD_UCONTEXT is defined) it falls back to getcontext/makecontext/swapcontext.
+
+   Unlike swapcontext, the fast switch does NOT save or restore the signal mask:
+   the mask in effect after mctx_switch() returns is the one of the thread that
+   switched back. A context created by mctx_make() starts with the signal mask that
+   was in effect when it was created, as with makecontext */
+
+#if (defined(__x86_64__) || defined(__aarch64__)) && !defined(MYTHREAD_UCONTEXT)
+#define MCTX_FAST 1
+#endif
+
+typedef struct mctx
+{
+#ifdef MCTX_FAST
+  void* sp; /* Saved stack pointer, the registers are on the stack */
+#else
+  ucontext_t uc;
+#endif
+  void (*fn)(void*); /* Entry point of a context created by mctx_make() */
+  void* arg;
+  sigset_t start_mask; /* Signal mask when the context was created */
+} mctx_t;
+
+/* Prepare ctx to run fn(arg) on the given stack. fn must not return */
+void mctx_make(mctx_t* ctx, void* stack, size_t size, void (*fn)(void*), void* arg);
+/* Save the current context in from and resume to. Returns -1 on error */
+int mctx_switch(mctx_t* from, mctx_t* to);
+/* Resume to, the current context is discarded. Only returns on error (-1) */
+int mctx_jump(mctx_t* to);
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+
+#include "disk.h"
+#include "interrupt.h"
+
+/* Requests not taken by a helper yet, FIFO */
+static struct disk_request *pending_head = NULL;
+static struct disk_request *pending_tail = NULL;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+
+/* Requests done, pushed by the helpers without a lock (LIFO) */
+static struct disk_request *completed = NULL;
+
+/* Simulation: the reads submitted, in completion order, and when each helper is free */
+static int simulated = 0;
+static struct disk_request *scheduled = NULL;
+static long long helper_free[DISK_HELPERS];
+
+/* Statistics of the batches taken by disk_completed() */
+static long batches = 0;
+static long reads = 0;
+static long max_batch = 0;
+static long histogram[DISK_BATCH_BUCKETS];
+
+
+static void *helper_main(void *arg)
+{
+  struct disk_request *r;
+  sigset_t mask;
+
+  //The clock and disk interrupts are for the workers only
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  while (1) {
+    pthread_mutex_lock(&pending_lock);
+    while (pending_head == NULL) pthread_cond_wait(&pending_cond, &pending_lock);
+    r = pending_head;
+    pending_head = r->next;
+    if (pending_head == NULL) pending_tail = NULL;
+    pthread_mutex_unlock(&pending_lock);
+
+    r->result = pread(r->fd, r->buf, r->len, r->offset);
+    r->error = r->result < 0 ? errno : 0;
+
+    r->next = __atomic_load_n(&completed, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&completed, &r->next, r, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    //Disk interrupt. If the list was not empty the interrupt of the first request is still
+    //to be handled, and it takes this one too
+    if (r->next == NULL) kill(getpid(), SIGPROF);
+  }
+  return NULL;
+}
+
+
+void disk_init(int helpers)
+{
+  pthread_t thread;
+  int i;
+
+  for (i = 0; i < helpers; i++) {
+    if (pthread_create(&thread, NULL, helper_main, NULL) != 0) {
+      perror("*** ERROR: failed to create the disk helper");
+      exit(-1);
+    }
+    pthread_detach(thread);
+  }
+}
+
+
+void disk_init_simulated()
+{
+  simulated = 1;
+}
+
+/* Reads r at once and schedules its completion: the first helper free takes it */
+static void simulate(struct disk_request *r)
+{
+  struct disk_request **p;
+  long long start;
+  int i, first = 0;
+
+  r->result = pread(r->fd, r->buf, r->len, r->offset);
+  r->error = r->result < 0 ? errno : 0;
+
+  for (i = 1; i < DISK_HELPERS; i++)
+    if (helper_free[i] < helper_free[first]) first = i;
+  start = clock_now();
+  if (helper_free[first] > start) start = helper_free[first];
+  r->due = start + DISK_SIM_SEEK + (long long) r->len * DISK_SIM_BYTE;
+  helper_free[first] = r->due;
+
+  //After the ones due at the same time, as a FIFO
+  for (p = &scheduled; *p != NULL && (*p)->due <= r->due; p = &(*p)->next);
+  r->next = *p;
+  *p = r;
+  disk_interrupt_at(scheduled->due);
+}
+
+/* The interrupts are blocked, so the lock can not be held by an interrupted context of
+   this kernel thread */
+void disk_submit(struct disk_request *r)
+{
+  if (simulated) {
+    simulate(r);
+    return;
+  }
+  r->next = NULL;
+  pthread_mutex_lock(&pending_lock);
+  if (pending_tail != NULL) pending_tail->next = r;
+  else pending_head = r;
+  pending_tail = r;
+  pthread_cond_signal(&pending_cond);
+  pthread_mutex_unlock(&pending_lock);
+}
+
+
+/* Simulation: the scheduled reads due by now, in completion order */
+static struct disk_request* simulated_completed()
+{
+  struct disk_request *done = NULL, **tail = &done;
+  long long now = clock_now();
+
+  while (scheduled != NULL && scheduled->due <= now) {
+    *tail = scheduled;
+    tail = &scheduled->next;
+    scheduled = scheduled->next;
+  }
+  *tail = NULL;
+  disk_interrupt_at(scheduled != NULL ? scheduled->due : LLONG_MAX);
+  return done;
+}
+
+struct disk_request* disk_completed(int *count)
+{
+  struct disk_request *r, *ordered = NULL, *next;
+  long max;
+  int n = 0, b = 0;
+
+  if (simulated) {
+    ordered = simulated_completed();
+    for (r = ordered; r != NULL; r = r->next) n++;
+  } else {
+    r = __atomic_exchange_n(&completed, NULL, __ATOMIC_ACQUIRE);
+    //Completion order
+    while (r != NULL) {
+      next = r->next;
+      r->next = ordered;
+      ordered = r;
+      r = next;
+      n++;
+    }
+  }
+  *count = n;
+  if (n == 0) return NULL;
+
+  while (b < DISK_BATCH_BUCKETS - 1 && (n >> (b + 1)) != 0) b++;
+  __atomic_add_fetch(&histogram[b], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&batches, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&reads, n, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&max_batch, __ATOMIC_RELAXED);
+  while (n > max && !__atomic_compare_exchange_n(&max_batch, &max, n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return ordered;
+}
+
+
+void disk_report(FILE *out)
+{
+  int b;
+
+  fprintf(out, "*** DISK: %ld reads in %ld interrupts (%.2f per interrupt, max %ld), batch sizes:",
+          reads, batches, batches > 0 ? (double) reads / batches : 0.0, max_batch);
+  for (b = 0; b < DISK_BATCH_BUCKETS; b++) {
+    if (b == DISK_BATCH_BUCKETS - 1) fprintf(out, " %d+: %ld", 1 << b, histogram[b]);
+    else if (b == 0) fprintf(out, " 1: %ld", histogram[b]);
+    else fprintf(out, " %d-%d: %ld", 1 << b, (2 << b) - 1, histogram[b]);
+  }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,52 @@
+#ifndef _DISK_H_
+#define _DISK_H_
+
+#include <sys/types.h>
+
+#include "mythread.h"
+
+/* Asynchronous disk reads, done by a pool of helper kernel threads.
+   A request is submitted, read by a helper with pread() and put in the completed list.
+   The process gets a disk interrupt (SIGPROF) when the list stops being empty, and the
+   disk interrupt takes every completed request at once (a batch) and makes their threads
+   ready */
+
+/* Helper kernel threads started by disk_init() */
+#define DISK_HELPERS 4
+/* Simulated disk (see disk_init_simulated): every helper serves one read at a time,
+   in DISK_SIM_SEEK ns plus DISK_SIM_BYTE ns per byte of the virtual clock */
+#define DISK_SIM_SEEK 4000000
+#define DISK_SIM_BYTE 10
+/* Buckets of the batch size histogram: 1, 2-3, 4-7, ..., the last one is open */
+#define DISK_BATCH_BUCKETS 8
+
+struct disk_request
+{
+  int fd;
+  off_t offset;
+  void *buf;
+  size_t len;
+  /* Bytes read, or -1 and the error in error */
+  ssize_t result;
+  int error;
+  /* Thread waiting for it */
+  TCB *thread;
+  /* Simulated disk: when it completes, in ns of the virtual clock */
+  long long due;
+  struct disk_request *next;
+};
+
+/* Starts the helper threads. Called with the interrupts blocked, the helpers never take them */
+void disk_init(int helpers);
+/* Simulation mode, instead of disk_init(): a read is done at once, and it completes on the
+   virtual clock (see set_virtual_clock) as it would on a disk served by DISK_HELPERS helpers */
+void disk_init_simulated();
+/* Queues a read. Called with the interrupts blocked */
+void disk_submit(struct disk_request *r);
+/* Takes every completed request (a list linked by next), NULL if there is none.
+   The number of requests taken is stored in count */
+struct disk_request* disk_completed(int *count);
+/* Prints the number of interrupts and reads, and the batch size histogram */
+void disk_report(FILE *out);
+
+#endif
@@ -0,0 +1,176 @@
+#include  <stdio.h>
+#include  <stdlib.h>
+
+#include "heap.h"
+
+/* 1 if the node at a must be closer to the root than the one at b. A macro over
+   pointers, so the sifts do not pay a call nor an index product per step in the -O0 build */
+#define HEAP_BEFORE(a, b) ((a)->sort < (b)->sort || ((a)->sort == (b)->sort && (int)((a)->seq - (b)->seq) > 0))
+
+/* Moves the node at i up to its place */
+static void heap_sift_up(struct tcb_heap* h, int i)
+{
+  struct tcb_heap_node* nodes = h->nodes;
+  struct tcb_heap_node node = nodes[i];
+  struct tcb_heap_node* parent;
+
+  while (i > 0) {
+    parent = &nodes[(i - 1) / 2];
+    if (!HEAP_BEFORE(&node, parent)) break;
+    nodes[i] = *parent;
+    i = (i - 1) / 2;
+  }
+  nodes[i] = node;
+}
+
+/* Moves the node at i down to its place */
+static void heap_sift_down(struct tcb_heap* h, int i)
+{
+  struct tcb_heap_node* nodes = h->nodes;
+  struct tcb_heap_node node = nodes[i];
+  struct tcb_heap_node* child;
+  int c;
+
+  while ((c = 2 * i + 1) < h->size) {
+    child = &nodes[c];
+    if (c + 1 < h->size && HEAP_BEFORE(child + 1, child)) {
+      child++;
+      c++;
+    }
+    if (!HEAP_BEFORE(child, &node)) break;
+    nodes[i] = *child;
+    i = c;
+  }
+  nodes[i] = node;
+}
+
+/* Fills the root after a pop with the last node. The last node belongs near the bottom,
+   so the hole goes down to a leaf comparing only the two children, and the node goes up
+   from there: about half the comparisons of heap_sift_down() */
+static void heap_pop_root(struct tcb_heap* h)
+{
+  struct tcb_heap_node* nodes = h->nodes;
+  struct tcb_heap_node* child;
+  int i = 0, c;
+
+  while ((c = 2 * i + 1) < h->size) {
+    child = &nodes[c];
+    if (c + 1 < h->size && HEAP_BEFORE(child + 1, child)) {
+      child++;
+      c++;
+    }
+    nodes[i] = *child;
+    i = c;
+  }
+  nodes[i] = nodes[h->size];
+  heap_sift_up(h, i);
+}
+
+
+struct tcb_heap* tcb_heap_new(int capacity)
+{
+  struct tcb_heap* h = malloc(sizeof(struct tcb_heap));
+  if( NULL == h )
+    {
+      fprintf(stderr, "LINE: %d, malloc() failed\n", __LINE__);
+      return NULL;
+    }
+  h->nodes = NULL;
+  h->size = h->capacity = 0;
+  h->seq = 0;
+  if (tcb_heap_reserve(h, capacity) == -1) {
+    free(h);
+    return NULL;
+  }
+  return h;
+}
+
+
+int tcb_heap_reserve(struct tcb_heap* h, int capacity)
+{
+  struct tcb_heap_node* nodes;
+
+  if (capacity <= h->capacity) return 0;
+  nodes = realloc(h->nodes, capacity * sizeof(struct tcb_heap_node));
+  if( NULL == nodes )
+    {
+      fprintf(stderr, "IN %s, %s: realloc() failed\n", __FILE__, "tcb_heap_reserve");
+      return -1;
+    }
+  h->nodes = nodes;
+  h->capacity = capacity;
+  return 0;
+}
+
+
+struct tcb_heap* tcb_heap_push(struct tcb_heap* h, TCB* tcb, long sort)
+{
+  struct tcb_heap_node* node;
+
+  if( NULL == h )
+    return h;
+  /* Only grows if the caller did not reserve enough room. Dropping the TCB would lose the thread */
+  if (h->size == h->capacity && tcb_heap_reserve(h, h->capacity ? 2 * h->capacity : 16) == -1)
+    {
+      printf("*** ERROR: failed to grow the heap\n");
+      exit(-1);
+    }
+
+  node = &h->nodes[h->size];
+  node->sort = sort;
+  node->seq = h->seq++;
+  node->tcb = tcb;
+  heap_sift_up(h, h->size++);
+  return h;
+}
+
+
+TCB* tcb_heap_pop(struct tcb_heap* h)
+{
+  TCB* tcb;
+
+  if( NULL == h || h->size == 0 )
+    return NULL;
+  tcb = h->nodes[0].tcb;
+  if (--h->size > 0) heap_pop_root(h);
+  return tcb;
+}
+
+
+TCB* tcb_heap_peek(struct tcb_heap* h)
+{
+  if( NULL == h || h->size == 0 )
+    return NULL;
+  return h->nodes[0].tcb;
+}
+
+
+long tcb_heap_peek_key(struct tcb_heap* h)
+{
+  if( NULL == h || h->size == 0 )
+    return LONG_MAX;
+  return h->nodes[0].sort;
+}
+
+
+TCB* tcb_heap_remove(struct tcb_heap* h, TCB* tcb)
+{
+  int i;
+
+  if( NULL == h || NULL == tcb )
+    return NULL;
+  for (i = 0; i < h->size && h->nodes[i].tcb != tcb; i++);
+  if( i == h->size )
+    return NULL;
+
+  h->size--;
+  if (i != h->size) {
+    h->nodes[i] = h->nodes[h->size];
+    if (i > 0 && HEAP_BEFORE(&h->nodes[i], &h->nodes[(i - 1) / 2])) heap_sift_up(h, i);
+    else heap_sift_down(h, i);
+  }
+  return tcb;
+}
+
+
+int tcb_heap_empty(struct tcb_heap* h) { return (h->size == 0); }
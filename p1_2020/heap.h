@@ -0,0 +1,47 @@
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include  <stdio.h>
+#include  <stdlib.h>
+#include  <limits.h>
+
+#include "mythread.h"
+
+/* Binary min-heap of TCBs.
+   Peek is O(1), push and pop are O(log n). The key and the insertion order are kept
+   next to the TCB pointer in the node array, so the sifts compare inside the array and
+   never read a TCB. Removing a TCB from the middle looks for it in the array, O(n).
+   Between equal keys the most recently pushed TCB goes first, as in sorted_enqueue() */
+struct tcb_heap_node
+{
+  long sort;
+  unsigned int seq; /* Insertion order, breaks ties between equal keys */
+  TCB* tcb;
+};
+
+struct tcb_heap
+{
+  struct tcb_heap_node* nodes;
+  int size;
+  int capacity;
+  unsigned int seq;
+};
+
+/* Create an empty heap with room for capacity TCBs */
+struct tcb_heap* tcb_heap_new(int capacity);
+/* Make room for capacity TCBs, so that later pushes do not allocate. Returns -1 on error */
+int tcb_heap_reserve(struct tcb_heap* h, int capacity);
+/* Insert a TCB with key sort */
+struct tcb_heap* tcb_heap_push(struct tcb_heap* h, TCB* tcb, long sort);
+/* Remove and return the TCB with the smallest key. Returns NULL if the heap is empty */
+TCB* tcb_heap_pop(struct tcb_heap* h);
+/* Return the TCB with the smallest key without removing it. Returns NULL if the heap is empty */
+TCB* tcb_heap_peek(struct tcb_heap* h);
+/* Return the smallest key, the one the TCB was pushed with. LONG_MAX if the heap is empty */
+long tcb_heap_peek_key(struct tcb_heap* h);
+/* If the TCB is in the heap it removes it and returns it. Otherwise it returns NULL */
+TCB* tcb_heap_remove(struct tcb_heap* h, TCB* tcb);
+/* Return 1 if the heap is empty and 0 otherwise */
+int tcb_heap_empty(struct tcb_heap* h);
+
+#endif
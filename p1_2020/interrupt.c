@@ -6,24 +6,43 @@
 #include <unistd.h>
 #include <interrupt.h>
 #include <time.h>
+#include <limits.h>
+#include <sys/syscall.h>
 
-static sigset_t maskval_interrupt,oldmask_interrupt;
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
 
+/* Thread local: in M:N mode every kernel thread saves and restores its own mask */
+static __thread sigset_t maskval_interrupt;
 
-void reset_timer(long usec) {
-  struct itimerval quantum;
-  /* Intialize an interval corresponding to round-robin quantum*/
-  quantum.it_interval.tv_sec = usec / 1000000;
-  quantum.it_interval.tv_usec = usec % 1000000;
-  /* Initialize the remaining time from current quantum */
-  quantum.it_value.tv_sec = usec / 1000000;
-  quantum.it_value.tv_usec = usec % 1000000;
-  /* Activate the virtual timer to generate a SIGVTALRM signal when the quantum is over */
-  if(setitimer(ITIMER_VIRTUAL, &quantum, (struct itimerval *)0) == -1){
-    perror("setitimer");
-    exit(3);
-  }
-}
+/* Tick source: a POSIX timer per kernel thread, delivering SIGVTALRM to that thread
+   only. It counts the CPU time of the thread (CLOCK_THREAD_CPUTIME_ID, the default,
+   as the old ITIMER_VIRTUAL) or the wall clock (CLOCK_MONOTONIC). See set_tick() */
+static clockid_t tick_clock = CLOCK_THREAD_CPUTIME_ID;
+static long tick_nsec = TICK_TIME * 1000L;
+static int tickless = 0;
+static int handler_installed = 0;
+
+static __thread timer_t tick_timer;
+/* Ticks covered by the one-shot timer armed last, and by the one that fired (tickless mode) */
+static __thread int tick_armed = 1;
+static __thread int tick_elapsed = 1;
+
+/* Virtual clock (see set_virtual_clock). virtual_ns is the time of the process and
+   virtual_cpu the CPU time of its only kernel thread, the tick counts the latter as the
+   default clock does. The next tick and the next disk interrupt are due at next_tick
+   (CPU time) and disk_due (process time), LLONG_MAX if none */
+static int virtual = 0;
+static long long virtual_ns = 0;
+static long long virtual_cpu = 0;
+static long long next_tick = LLONG_MAX;
+static long long disk_due = LLONG_MAX;
+
+
+#ifdef MYTHREAD_SIGPROCMASK
+
+static __thread sigset_t oldmask_interrupt;
 
 void enable_interrupt(){
   sigprocmask(SIG_SETMASK, &oldmask_interrupt, NULL);
@@ -34,16 +53,88 @@ void disable_interrupt(){
   sigprocmask(SIG_BLOCK, &maskval_interrupt, &oldmask_interrupt);
 }
 
+#else
+
+/* Deferred preemption: disable_interrupt()/enable_interrupt() only update a per kernel
+   thread nesting counter, with no system call. A signal that arrives inside the
+   critical section is recorded by the handler and replayed when the outermost
+   section ends (see replay_interrupt). Define MYTHREAD_SIGPROCMASK to block the
+   signals with sigprocmask instead.
+   Voluntary context switches do not use them: block_interrupts()/unblock_interrupts()
+   still cost two sigprocmask calls per switch */
+static __thread volatile sig_atomic_t clock_disabled, clock_pending;
+static __thread volatile sig_atomic_t disk_disabled, disk_pending;
+
+/* Run a deferred handler as the kernel would: with both interrupts blocked,
+   restoring the previous mask afterwards. Slow path only */
+static void replay_interrupt(void (*handler)())
+{
+  sigset_t mask, old;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGVTALRM);
+  sigaddset(&mask, SIGPROF);
+  sigprocmask(SIG_BLOCK, &mask, &old);
+  handler();
+  sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void disable_interrupt(){
+  clock_disabled++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void enable_interrupt(){
+  void my_handler();
+
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (--clock_disabled == 0 && clock_pending) {
+    clock_pending = 0;
+    replay_interrupt(my_handler);
+  }
+}
+
+#endif
+
+/* Block or unblock the clock and the disk interrupts at once, without touching the
+   masks saved by disable_interrupt()/disable_disk_interrupt().
+   Used around voluntary context switches: the fast context switch does not carry
+   the signal mask, so every switch is done with both interrupts blocked.
+   These are real sigprocmask calls, not the deferred counters: a preempted thread is
+   resumed from the clock handler with the signals blocked by the kernel, and the
+   thread that switched voluntarily must resume in the same state */
+void block_interrupts(){
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGVTALRM);
+  sigaddset(&mask, SIGPROF);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+}
+
+void unblock_interrupts(){
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGVTALRM);
+  sigaddset(&mask, SIGPROF);
+  sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
 void my_handler ()
 {
-   reset_timer(TICK_TIME) ;
+#ifndef MYTHREAD_SIGPROCMASK
+   if (clock_disabled) { clock_pending = 1; return; }
+#endif
+   /* A periodic timer needs no re-arming. In tickless mode the next tick is armed by
+      default, timer_interrupt() can arm a later one with arm_next_tick() */
+   if (tickless) {
+     tick_elapsed = tick_armed;
+     arm_next_tick(1);
+   }
    timer_interrupt() ;
 }
 
 
-void init_interrupt()
+static void install_timer_handler()
 {
-  void timer_interrupt(int sig);
   struct sigaction sigdat;
   /* Initializes the signal mask to empty */
   sigemptyset(&maskval_interrupt); 
@@ -55,10 +146,113 @@ void init_interrupt()
     perror("signal set error");
     exit(2);
   }
-   reset_timer(TICK_TIME) ;
 }
 
-static sigset_t maskval_net_interrupt,oldmask_net_interrupt;
+
+static void ticks_to_timespec(long ticks, struct timespec *ts)
+{
+  long long nsec = (long long)ticks * tick_nsec;
+
+  ts->tv_sec = nsec / 1000000000LL;
+  ts->tv_nsec = nsec % 1000000000LL;
+}
+
+
+/* Selects the clock and the length of the tick (it can be below 1 ms), and the
+   tickless mode, where the timer is one-shot and only fires when the scheduler has
+   a decision to take (see arm_next_tick). Must be called before init_interrupt().
+   Quanta and execution times are counted in ticks, so they scale with the tick.
+   The kernel samples CPU time clocks at its own tick (a few ms): periodic ticks
+   below that need CLOCK_MONOTONIC */
+void set_tick(clockid_t clock, long nsec, int tickless_mode)
+{
+  tick_clock = clock;
+  if (nsec > 0) tick_nsec = nsec;
+  tickless = tickless_mode;
+}
+
+
+/* Tickless mode: the next timer interrupt fires after ticks ticks, never if ticks <= 0.
+   Does nothing with a periodic tick */
+void arm_next_tick(int ticks)
+{
+  struct itimerspec timerdata;
+
+  if (!tickless) return;
+  tick_armed = ticks > 0 ? ticks : 1;
+  if (virtual) {
+    next_tick = ticks > 0 ? virtual_cpu + (long long) ticks * tick_nsec : LLONG_MAX;
+    return;
+  }
+  timerdata.it_interval.tv_sec = 0;
+  timerdata.it_interval.tv_nsec = 0;
+  ticks_to_timespec(ticks > 0 ? ticks : 0, &timerdata.it_value);
+  if (timer_settime(tick_timer, 0, &timerdata, NULL) == -1) {
+    perror("timer_settime");
+    exit(3);
+  }
+}
+
+
+/* Ticks elapsed since the previous timer interrupt: always 1 with a periodic tick */
+int elapsed_ticks()
+{
+  return tickless ? tick_elapsed : 1;
+}
+
+
+/* Length of a tick in ns (see set_tick) */
+long tick_length()
+{
+  return tick_nsec;
+}
+
+
+/* Tick timer of the calling kernel thread. The first call installs the handler.
+   In M:N mode every worker calls it, each one gets its own timer */
+void init_thread_interrupt()
+{
+  struct sigevent event;
+  struct itimerspec timerdata;
+
+  if (!handler_installed) {
+    install_timer_handler();
+    handler_installed = 1;
+  }
+  //The first tick is due after one tick of CPU time, as the real one
+  if (virtual) {
+    next_tick = virtual_cpu + tick_nsec;
+    return;
+  }
+
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGVTALRM;
+  event.sigev_notify_thread_id = syscall(SYS_gettid);
+  if (timer_create(tick_clock, &event, &tick_timer) == -1) {
+    perror("timer_create");
+    exit(3);
+  }
+
+  ticks_to_timespec(1, &timerdata.it_value);
+  if (tickless) {
+    timerdata.it_interval.tv_sec = 0;
+    timerdata.it_interval.tv_nsec = 0;
+  } else {
+    timerdata.it_interval = timerdata.it_value;
+  }
+  if (timer_settime(tick_timer, 0, &timerdata, NULL) == -1) {
+    perror("timer_settime");
+    exit(3);
+  }
+}
+
+
+void init_interrupt()
+{
+  init_thread_interrupt();
+}
+
+static __thread sigset_t maskval_net_interrupt;
 
 void reset_disk_timer(long usec) {
   struct itimerval quantum;
@@ -76,6 +270,10 @@ void reset_disk_timer(long usec) {
   }
 }
 
+#ifdef MYTHREAD_SIGPROCMASK
+
+static __thread sigset_t oldmask_net_interrupt;
+
 void enable_disk_interrupt(){
   sigprocmask(SIG_SETMASK, &oldmask_net_interrupt, NULL);
 }
@@ -85,29 +283,41 @@ void disable_disk_interrupt(){
   sigprocmask(SIG_BLOCK, &maskval_net_interrupt, &oldmask_net_interrupt);
 }
 
+#else
+
+/* Same deferred scheme as the clock interrupt */
+void disable_disk_interrupt(){
+  disk_disabled++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void enable_disk_interrupt(){
+  void my_disk_handler();
+
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (--disk_disabled == 0 && disk_pending) {
+    disk_pending = 0;
+    replay_interrupt(my_disk_handler);
+  }
+}
+
+#endif
+
 void my_disk_handler ()
 {
+#ifndef MYTHREAD_SIGPROCMASK
+   if (disk_disabled) { disk_pending = 1; return; }
+#endif
   // reset_disk_timer(PACK_TIME) ;
    disk_interrupt() ;
 }
 
 
+/* The disk interrupt is raised by the disk helpers, once per completed read (see disk.c) */
 void init_disk_interrupt()
 {
   void disk_interrupt(int sig);
-  struct sigevent event;
-  timer_t timer_id;
-  struct timespec periodTime;
-  struct itimerspec timerdata; 
   struct sigaction sigdat;
- /* Create timer */
- event.sigev_notify = SIGEV_SIGNAL;
- event.sigev_signo = SIGPROF;
- timer_create (CLOCK_REALTIME, &event, &timer_id);
-  
- // set periodTime time
- periodTime.tv_sec=1;
- periodTime.tv_nsec=0;
 
  /* Initializes the signal mask to empty */
  sigemptyset(&maskval_net_interrupt); 
@@ -117,11 +327,6 @@ void init_disk_interrupt()
  sigemptyset(&sigdat.sa_mask);
  sigdat.sa_flags = SA_RESTART;
 
- /* Arm periodic timer */
- timerdata.it_interval = periodTime;
- timerdata.it_value = periodTime;
- timer_settime (timer_id, 0, &timerdata, NULL);
-
  if(sigaction(SIGPROF, &sigdat, (struct sigaction *)0) == -1){
     perror("signal set error");
     exit(2);
@@ -136,3 +341,74 @@ void init_disk_interrupt()
  srand(ts.tv_nsec);
 #endif
 }
+
+
+/* Simulation mode: there are no timer nor disk signals, the time is a virtual clock
+   moved by the library. It advances when a thread runs (run_virtual) and jumps to the
+   next event when nothing runs (wait_virtual), so an idle gap takes no time. The tick
+   and the disk interrupts are called when the clock reaches them, at the same points
+   of every execution. Only one kernel thread, must be called before init_interrupt() */
+void set_virtual_clock()
+{
+  virtual = 1;
+}
+
+/* ns of the virtual clock, or of CLOCK_MONOTONIC */
+long long clock_now()
+{
+  struct timespec ts;
+
+  if (virtual) return virtual_ns;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Calls a handler as the signal would, with both interrupts blocked */
+static void raise_virtual(void (*handler)())
+{
+  block_interrupts();
+  handler();
+  unblock_interrupts();
+}
+
+/* The calling thread runs for nsec ns of CPU time. The interrupts due meanwhile are
+   taken at their time: the tick may switch to another thread, which moves the clock in
+   turn, and this one goes on with the rest when it runs again */
+void run_virtual(long long nsec)
+{
+  long long step;
+
+  while (nsec > 0) {
+    step = nsec;
+    if (next_tick != LLONG_MAX && next_tick - virtual_cpu < step) step = next_tick - virtual_cpu;
+    if (disk_due != LLONG_MAX && disk_due - virtual_ns < step) step = disk_due - virtual_ns;
+    if (step < 0) step = 0;
+    virtual_ns += step;
+    virtual_cpu += step;
+    nsec -= step;
+
+    if (virtual_ns >= disk_due) raise_virtual(my_disk_handler);
+    if (virtual_cpu >= next_tick) {
+      //Periodic: the next one a tick later. Tickless: my_handler() arms it
+      next_tick = tickless ? LLONG_MAX : next_tick + tick_nsec;
+      raise_virtual(my_handler);
+    }
+  }
+}
+
+/* The kernel thread waits, with no CPU time, until until or the next disk interrupt, taken
+   then. Called with the interrupts blocked. Returns -1 if there is nothing to wait for */
+int wait_virtual(long long until)
+{
+  if (disk_due < until) until = disk_due;
+  if (until == LLONG_MAX) return -1;
+  if (until > virtual_ns) virtual_ns = until;
+  if (virtual_ns >= disk_due) my_disk_handler();
+  return 0;
+}
+
+/* The next disk interrupt is due at when (process time), LLONG_MAX: none */
+void disk_interrupt_at(long long when)
+{
+  disk_due = when;
+}
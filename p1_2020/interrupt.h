@@ -19,10 +19,25 @@
 
 void timer_interrupt ();
 void init_interrupt();
+void init_thread_interrupt();
+void set_tick(clockid_t clock, long nsec, int tickless_mode);
+void arm_next_tick(int ticks);
+int elapsed_ticks();
+long tick_length();
 void disable_interrupt();
 void enable_interrupt();
 
+void block_interrupts();
+void unblock_interrupts();
+
 void disk_interrupt ();
 void init_disk_interrupt();
 void disable_disk_interrupt();
 void enable_disk_interrupt();
+
+/* Virtual clock, for deterministic simulations (see set_virtual_clock) */
+void set_virtual_clock();
+long long clock_now();
+void run_virtual(long long nsec);
+int wait_virtual(long long until);
+void disk_interrupt_at(long long when);
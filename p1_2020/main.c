@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <ucontext.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "mythread.h"
 
@@ -15,8 +16,16 @@ extern void function_thread(int sec);
 
 int main(int argc, char *argv[])
 {
-  int j, k, l, m, a, b, f;
+  int j, k, l, m, a, b, f, fd;
+  char buf[4096];
 
+  //The reads are done on the program file, dropped from the page cache so they go to the disk
+  fd = open(argv[0], O_RDONLY);
+  if (fd == -1) {
+    perror("*** ERROR: open");
+    exit(-1);
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
 
   mythread_setpriority(LOW_PRIORITY);
   if((f = mythread_create(function_thread,HIGH_PRIORITY,2)) == -1){
@@ -24,8 +33,8 @@ int main(int argc, char *argv[])
       exit(-1);
   }
   
-  read_disk();
-  read_disk();
+  read_disk(fd, 0, buf, sizeof(buf));
+  read_disk(fd, sizeof(buf), buf, sizeof(buf));
 
   if((j = mythread_create(function_thread,HIGH_PRIORITY, 2)) == -1){
     printf("thread failed to initialize\n");
@@ -44,7 +53,7 @@ int main(int argc, char *argv[])
     printf("thread failed to initialize\n");
     exit(-1);
   }
-  read_disk();
+  read_disk(fd, 2 * sizeof(buf), buf, sizeof(buf));
       
      
   for (a = 0; a < 10; ++a) {
@@ -10,13 +10,16 @@
 #include <unistd.h>
 
 #include "interrupt.h"
+#include "context.h"
+#include "timer_wheel.h"
 
-#define N 1000
+#define MAX_THREADS (1 << 20) /* Maximum number of live threads */
 #define FREE 0
 #define INIT 1
 #define WAITING 2
 #define IDLE 3
 #define RUNNING 4
+#define EXITED 5 /* A joinable thread that finished, kept until it is joined */
 
 #define STACKSIZE 10000
 #define QUANTUM_TICKS 40 //Quantum /TICKS
@@ -24,7 +27,98 @@
 
 #define LOW_PRIORITY 0
 #define HIGH_PRIORITY 1
-#define SYSTEM 2
+/* User priorities go from LOW_PRIORITY to MAX_PRIORITY (the most urgent). Only the prio
+   policy tells apart the ones above HIGH_PRIORITY, each one has its own run queue */
+#define MAX_PRIORITY 63
+#define PRIORITY_LEVELS (MAX_PRIORITY + 1)
+#define SYSTEM (MAX_PRIORITY + 1)
+#define REALTIME (MAX_PRIORITY + 2) /* Deadline threads, see mythread_create_deadline() */
+
+#define MIN_NICE -20
+#define MAX_NICE 19
+
+/* Deadline misses of a deadline thread (edf policy) */
+struct mythread_deadline_stats
+{
+  long jobs; /* Jobs released: one, or one per period */
+  long misses; /* Jobs not done by their deadline */
+  long max_lateness; /* Ticks past the deadline of the latest job */
+};
+
+/* Where a thread spent its time, see mythread_stats() */
+struct mythread_stats
+{
+  long long run_ns; /* Running */
+  long long ready_ns; /* Ready, waiting for a worker */
+  long long io_ns; /* Waiting for read_disk() */
+  long long block_ns; /* Sleeping, or parked on a mutex, condition variable, semaphore, channel or join */
+  long voluntary; /* Switches to wait */
+  long involuntary; /* Switches by preemption */
+  long quanta; /* Time slices used up */
+};
+
+struct tcb_queue;
+
+/* Synchronization objects, see sync.c. A thread that has to wait is parked on the wait
+   queue of the object and takes no CPU. The timed variants give up after nsec ns */
+typedef struct mythread_mutex
+{
+  int state; /* 0: unlocked, 1: locked, 2: locked and there may be waiters */
+  int owner; /* tid of the owner, -1 if unlocked */
+  int lock; /* Protects the wait queue */
+  struct tcb_queue *waiters;
+} mythread_mutex_t;
+
+typedef struct mythread_cond
+{
+  int lock;
+  struct tcb_queue *waiters;
+} mythread_cond_t;
+
+typedef struct mythread_sem
+{
+  int value;
+  int lock; /* Protects the value and the wait queue */
+  struct tcb_queue *waiters;
+} mythread_sem_t;
+
+/* Channels of pointers, see chan.c. A message is the pointer itself: the receiver gets
+   the same object the sender had, nothing is copied */
+typedef struct mythread_chan mythread_chan_t;
+
+#define MYTHREAD_CHAN_UNBOUNDED -1 /* Capacity of a channel with no limit */
+
+/* One operation of mythread_chan_select() */
+struct mythread_chan_op
+{
+  mythread_chan_t *chan;
+  int send; /* 1: sends msg, 0: receives into msg */
+  void *msg;
+  int closed; /* Set when the operation was done because the channel is closed */
+};
+
+/* Attributes of a thread created by mythread_spawn(), see mythread_attr_init() */
+typedef struct mythread_attr
+{
+  int stack_size; /* Bytes, rounded to the stack pool size classes */
+  int priority; /* LOW_PRIORITY to the maximum of the policy */
+  int seconds; /* Time budget, it is ejected when it runs out (0: no limit) */
+  int budget_ticks; /* Time budget in ticks (see tick_length), instead of seconds if > 0 */
+} mythread_attr_t;
+
+/* Real time parameters of a deadline thread, in ticks */
+struct rt_params
+{
+  int runtime; /* Budget of every job */
+  int deadline; /* Relative to the release of the job */
+  int period; /* 0 for a single job */
+  int budget; /* Left in the current job */
+  long release; /* Of the current job, in ticks of the timer wheel (see clock_now) */
+  long abs_deadline; /* Of the current job, in the same ticks. -1 until released */
+  int missed; /* The current job is already counted as a miss */
+  struct mythread_deadline_stats stats;
+};
+
 /* Structure containing thread state  */
 typedef struct tcb{
   int state; /* the state of the current block: FREE or INIT */
@@ -34,17 +128,84 @@ typedef struct tcb{
   int execution_total_ticks; /*Thread time to complete execution*/
   int remaining_ticks; /*Remaining ticks to complete the process execution*/
   void (*function)(int);  /* the code of the thread */
-  ucontext_t run_env; /* Context of the running environment*/
+  int arg; /* argument passed to function */
+  mctx_t run_env; /* Context of the running environment*/
+  void *stack; /* Stack from the stack pool (NULL for the main thread) */
+  size_t stack_size;
+  struct tcb *next; /* Link used by the intrusive queues (a TCB is in at most one queue) */
+  int switching; /* Preempted and queued already, its context is still being saved */
+  int nice; /* -20 (most CPU) to 19 (least CPU), weights the CPU share under the cfs policy */
+  int vruntime; /* Run time weighted by nice, cfs policy */
+  int vruntime_rem; /* Remainder of the weighted run time */
+  int level; /* Queue level under the mlfq policy, -1 until it is first queued */
+  long ready_since; /* When it was queued, in ticks of the mlfq worker clock */
+  struct rt_params rt; /* Deadline threads only (priority REALTIME) */
+  struct wheel_timer timer; /* Wake up of mythread_sleep(), timeout of a wait */
+  int wait_state; /* 1 while parked (2 with a timer), taken by the first of the waker and the timer */
+  int wait_result; /* 0 if resumed, -1 on timeout */
+  struct tcb_queue *wait_queue; /* Wait queue it is parked on (see wait.h), NULL if none */
+  int *wait_lock; /* Lock of that queue */
+  void *(*start)(void *); /* Body of a thread created by mythread_spawn(), NULL otherwise */
+  void *start_arg;
+  void *retval; /* Returned by start, for mythread_join() */
+  int joinable; /* Created by mythread_spawn() and not joined yet */
+  struct tcb *joiner; /* Thread parked in mythread_join() on it, NULL if none */
+  int join_lock; /* Protects joiner and the change to EXITED */
+  struct mythread_stats acct; /* Times in stats_now() units (see stats.h), not in ns */
+  long long acct_since; /* When it entered its current state, in stats_now() units */
+  int acct_reason; /* What it waits for: TRACE_IO, or the others (see trace.h) */
 }TCB;
 
 int mythread_create (void (*fun_addr)(), int priority,int seconds); /* Creates a new thread with one argument */
+int mythread_create_stack (void (*fun_addr)(), int priority, int seconds, int stack_size); /* Same, with a custom stack size */
+int mythread_create_deadline (void (*fun_addr)(), int runtime, int deadline, int period); /* Creates a deadline thread (edf policy), in ticks */
+int mythread_spawn(void *(*fn)(void *), void *arg, const mythread_attr_t *attr); /* Creates a joinable thread running fn(arg), attr NULL for the defaults */
+int mythread_join(int tid, void **ret); /* Waits for a spawned thread to finish, ret gets what fn returned */
+void mythread_attr_init(mythread_attr_t *attr); /* Default attributes: STACKSIZE, LOW_PRIORITY, no time budget */
+int mythread_deadline_stats(int tid, struct mythread_deadline_stats *stats); /* Deadline misses of a live deadline thread */
 void mythread_setpriority(int priority); /* Sets the thread priority */
 int mythread_getpriority(); /* Returns the priority of calling thread*/
+int mythread_setnice(int nice); /* Sets the nice value of the calling thread (MIN_NICE..MAX_NICE) */
+int mythread_getnice(); /* Returns the nice value of the calling thread */
 void mythread_exit(); /* Frees the thread structure and exits the thread */
 int mythread_gettid(); /* Returns the thread id */
-int read_disk(); /* */
+ssize_t read_disk(int fd, off_t offset, void *buf, size_t len); /* Reads from fd at offset, as pread() */
+int mythread_sleep(long long nsec); /* Sleeps the calling thread for at least nsec nanoseconds */
+void mythread_burn(long long nsec); /* Keeps the calling thread busy for nsec ns of its run time (virtual time in a simulation) */
 int seconds_to_ticks(int seconds);
+int mythread_set_workers(int n); /* Number of kernel threads running the threads, before any other call (n <= 0: one per core) */
+int mythread_set_policy(const char *name); /* Scheduling policy ("rr", "rrs", "rrsd", "cfs", "mlfq", "edf", "prio"), before any other call */
+int mythread_set_simulation(int on); /* Deterministic run on a virtual clock, before any other call */
+void mythread_policy_report(FILE *out); /* Prints the run queue statistics of the policy, if it keeps any */
+const char* mythread_policy_order(); /* What the policy sorts the ready threads by, NULL if none is set yet */
+int mythread_stats(int tid, struct mythread_stats *stats); /* Time and switches of a live or unjoined thread so far */
+void mythread_stats_report(FILE *out); /* Prints the stats of every live thread, and the total of the process */
+
+int mythread_mutex_init(mythread_mutex_t *m); /* Initializes an unlocked mutex */
+int mythread_mutex_destroy(mythread_mutex_t *m); /* Frees an unlocked mutex */
+int mythread_mutex_lock(mythread_mutex_t *m); /* Locks the mutex, waiting for it */
+int mythread_mutex_trylock(mythread_mutex_t *m); /* Locks the mutex if it is unlocked, -1 otherwise */
+int mythread_mutex_timedlock(mythread_mutex_t *m, long long nsec); /* Locks the mutex waiting at most nsec ns, -1 on timeout */
+int mythread_mutex_unlock(mythread_mutex_t *m); /* Unlocks the mutex, handing it to the first waiter */
+int mythread_cond_init(mythread_cond_t *c);
+int mythread_cond_destroy(mythread_cond_t *c);
+int mythread_cond_wait(mythread_cond_t *c, mythread_mutex_t *m); /* Unlocks m, waits for a signal and locks m again */
+int mythread_cond_timedwait(mythread_cond_t *c, mythread_mutex_t *m, long long nsec); /* Same, -1 after nsec ns with no signal */
+int mythread_cond_signal(mythread_cond_t *c); /* Wakes one waiter */
+int mythread_cond_broadcast(mythread_cond_t *c); /* Wakes every waiter */
+int mythread_sem_init(mythread_sem_t *s, int value);
+int mythread_sem_destroy(mythread_sem_t *s);
+int mythread_sem_wait(mythread_sem_t *s); /* Takes a unit, waiting for one */
+int mythread_sem_trywait(mythread_sem_t *s); /* Takes a unit if there is one, -1 otherwise */
+int mythread_sem_timedwait(mythread_sem_t *s, long long nsec); /* Takes a unit waiting at most nsec ns, -1 on timeout */
+int mythread_sem_post(mythread_sem_t *s); /* Gives a unit, straight to the first waiter if there is one */
+int mythread_sem_getvalue(mythread_sem_t *s); /* Units available */
 
-static inline int data_in_page_cache() { return rand() & 0x01; }
+mythread_chan_t* mythread_chan_new(int capacity); /* Channel of capacity messages (0: the sender waits for the receiver, MYTHREAD_CHAN_UNBOUNDED) */
+int mythread_chan_free(mythread_chan_t *ch); /* Frees a channel nobody waits on */
+int mythread_chan_close(mythread_chan_t *ch); /* No more sends, the messages sent can still be received */
+int mythread_chan_send(mythread_chan_t *ch, void *msg); /* Sends msg, waiting for room. -1 if the channel is closed */
+int mythread_chan_recv(mythread_chan_t *ch, void **msg); /* Receives a message, waiting for one. -1 if the channel is closed and empty */
+int mythread_chan_select(struct mythread_chan_op *ops, int n, long long nsec); /* Does the first of n operations that can be done, waiting at most nsec ns. Its index, -1 on timeout */
 
 #endif
@@ -1,15 +1,32 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/uio.h>
 #include <sys/time.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <ucontext.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "my_io.h"
 
 //#include "mythread.h"
 #include "interrupt.h"
 
 #include "queue.h"
+#include "tcb_store.h"
+#include "stack_pool.h"
+#include "trace.h"
+#include "policy.h"
+#include "disk.h"
+#include "wait.h"
+#include "stats.h"
 
 TCB* scheduler();
 void activator();
@@ -17,213 +34,1225 @@ void timer_interrupt(int sig);
 void disk_interrupt(int sig);
 
 
-/* Array of state thread control blocks: the process allows a maximum of N threads */
-static TCB t_state[N];
+/* Thread control blocks are kept in the growable tcb_store (see tcb_store.h) */
 
-/* Current running thread */
-static TCB* running;
-static int current = 0;
+/* Scheduling state of a worker, a kernel thread that runs the threads.
+   By default there is only one, the main kernel thread (1:N). With mythread_set_workers(n)
+   there are n (M:N), each one with its own run queue, idle thread and timer.
+   A worker with nothing to run steals ready threads from the others.
+   Which thread runs next is decided by the scheduling policy (see policy.h) */
+struct worker
+{
+  int id;
+
+  /* Current running thread */
+  TCB* running;
+  /* Last run thread*/
+  TCB* old_running;
+
+  /* Ready threads, owned by the policy */
+  void *rq;
+  /* Protects the run queue, the other workers steal from it */
+  pthread_spinlock_t lock;
+
+  /* Thread control block for the idle thread */
+  TCB idle;
+
+  /* A preempted thread competes with the ready ones, it is queued before the next one
+     is picked (see scheduler). The read of a thread that reads the disk is submitted,
+     and a finished one is released, only once its context is saved (see finish_switch) */
+  TCB* requeue;
+  TCB* block;
+  struct disk_request* block_io;
+  TCB* dead;
+  /* A sleeping thread, or a parked one with a timeout, goes to the timer wheel once its
+     context is saved, and a parked thread releases the lock of its wait queue then */
+  TCB* timed;
+  void (*park_unlock)(void *);
+  void *park_arg;
+  /* Why the thread that leaves the CPU waits (TRACE_IO, TRACE_TIMER or TRACE_SYNC) */
+  int wait_reason;
+
+  pthread_t kthread;
+};
+
+static struct worker *workers;
+static int num_workers = 1;
+
+/* Worker of the calling kernel thread */
+static __thread struct worker *self;
+
+/* Threads alive in the whole process, including the main one */
+static int live_threads = 0;
+static int finished = 0;
+
+/* Protects the tcb_store and the stack pool, shared by all the workers */
+static pthread_spinlock_t store_lock;
+
+/* Scheduling policy, chosen before the initialization (see mythread_set_policy) */
+static struct sched_policy *policy = NULL;
+
+/* Timers of the sleeping threads and of the timed waits, shared by all the workers.
+   The wheel counts ticks of the clock interrupt length on clock_now(). timer_next is
+   the next tick the wheel has to be advanced at (LONG_MAX: no timers), read without the lock */
+static struct timer_wheel timers;
+static pthread_spinlock_t timer_lock;
+static long timer_next = LONG_MAX;
+
+/* M:N idle workers sleep on a futex on idle_seq, which is bumped to wake them when
+   a thread is made ready. idle_sleepers counts the ones that may be asleep */
+static int idle_seq = 0;
+static int idle_sleepers = 0;
+
+/* Accounting of the threads released so far, in stats_now() units (see mythread_stats) */
+static struct mythread_stats acct_total;
+static long acct_threads = 0;
+
+/* Time spent by the idle threads, and start of the execution (clock_now()) */
+static long long idle_nsec = 0;
+static long long start_time;
+
+/* Simulation mode, on the virtual clock (see mythread_set_simulation) */
+static int simulation = 0;
 
-/* Last run thread*/
-static TCB* old_running;
+/* Variable indicating if the library is initialized (init == 1) or not (init == 0) */
+static int init = 0;
 
 
-/*Queue with the ready threads. One queue for high priority and other for low priority*/
-static struct  queue *high_ready_list;
-static struct queue *low_ready_list;
+/* Worker the caller runs on. A thread can be resumed by another worker after
+   a context switch, so it is read again after every switch (never inlined) */
+static __attribute__((noinline)) struct worker* this_worker()
+{
+  return self;
+}
 
-/* Variable indicating if the library is initialized (init == 1) or not (init == 0) */
-static int init = 0;
+/* Locks are only taken in M:N mode. The run queues and the timer wheel are also
+   used by the interrupt handlers, which are deferred while they are held */
+static void worker_lock(struct worker *w)
+{
+  disable_interrupt();
+  disable_disk_interrupt();
+  if (num_workers > 1) pthread_spin_lock(&w->lock);
+}
+
+static void worker_unlock(struct worker *w)
+{
+  if (num_workers > 1) pthread_spin_unlock(&w->lock);
+  enable_disk_interrupt();
+  enable_interrupt();
+}
+
+static void timer_lock_acquire()
+{
+  disable_interrupt();
+  disable_disk_interrupt();
+  if (num_workers > 1) pthread_spin_lock(&timer_lock);
+}
+
+static void timer_lock_release()
+{
+  if (num_workers > 1) pthread_spin_unlock(&timer_lock);
+  enable_disk_interrupt();
+  enable_interrupt();
+}
+
+static void store_lock_acquire()
+{
+  if (num_workers > 1) pthread_spin_lock(&store_lock);
+}
+
+static void store_lock_release()
+{
+  if (num_workers > 1) pthread_spin_unlock(&store_lock);
+}
+
+/* A thread was made ready: wakes an idle worker, if any, to run it or to steal it.
+   Called after the run queue is unlocked */
+static void wake_idle_worker()
+{
+  if (num_workers == 1) return;
+  //Pairs with the idle worker, which counts itself before it looks at the queues
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&idle_sleepers, __ATOMIC_RELAXED) == 0) return;
+  __atomic_add_fetch(&idle_seq, 1, __ATOMIC_SEQ_CST);
+  syscall(SYS_futex, &idle_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* Current tick of the timer wheel */
+static long wheel_now()
+{
+  return clock_now() / tick_length();
+}
+
+/* First tick at or after nsec ns from now */
+static long timeout_tick(long long nsec)
+{
+  return (clock_now() + nsec + tick_length() - 1) / tick_length();
+}
+
+/* Per thread accounting: a thread is charged the time since acct_since to the state it
+   leaves, once at every switch and once when it is woken up. One read of the cycle
+   counter per switch (see stats.h), no lock: a thread is only charged by the worker
+   that switches it or the one that wakes it, never at the same time */
+
+/* t leaves the CPU */
+static inline void account_leave(TCB *t, long long now)
+{
+  t->acct.run_ns += now - t->acct_since;
+  t->acct_since = now;
+}
+
+/* t is ready again after a wait */
+static inline void account_wake(TCB *t, long long now)
+{
+  if (t->acct_reason == TRACE_IO) t->acct.io_ns += now - t->acct_since;
+  else t->acct.block_ns += now - t->acct_since;
+  t->acct_since = now;
+}
+
+/* w switches from old, which may be its idle thread, to next. The state of old tells why */
+static void account_switch(struct worker *w, TCB *old, TCB *next)
+{
+  long long now = stats_now();
+
+  if (old != &w->idle) {
+    account_leave(old, now);
+    if (old->state == WAITING) {
+      old->acct.voluntary++;
+      old->acct_reason = w->wait_reason;
+    } else if (old->state == INIT) old->acct.involuntary++;
+  }
+  if (next != &w->idle) {
+    next->acct.ready_ns += now - next->acct_since;
+    next->acct_since = now;
+  }
+}
+
+/* t is released, its accounting goes to the total of the process */
+static void account_exit(TCB *t)
+{
+  __atomic_add_fetch(&acct_total.run_ns, t->acct.run_ns, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_total.ready_ns, t->acct.ready_ns, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_total.io_ns, t->acct.io_ns, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_total.block_ns, t->acct.block_ns, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_total.voluntary, t->acct.voluntary, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_total.involuntary, t->acct.involuntary, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_total.quanta, t->acct.quanta, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&acct_threads, 1, __ATOMIC_RELAXED);
+}
+
+/* Makes ready in w the threads whose timers expired. Only reads timer_next while
+   none is due */
+static void expire_timers(struct worker *w)
+{
+  struct wheel_timer *expired, *timer, *woken = NULL, **tail = &woken;
+  long now;
+  long long stamp;
+  TCB *t;
+
+  if (__atomic_load_n(&timer_next, __ATOMIC_ACQUIRE) == LONG_MAX) return;
+  now = wheel_now();
+  if (now < __atomic_load_n(&timer_next, __ATOMIC_ACQUIRE)) return;
+
+  timer_lock_acquire();
+  expired = wheel_advance(&timers, now);
+  __atomic_store_n(&timer_next, wheel_next_event(&timers), __ATOMIC_RELEASE);
+  //A parked thread may have been taken by a waker already (see wait_dequeue), then its
+  //timer is left alone: the thread can be parked again with it as soon as the lock is free
+  while (expired != NULL) {
+    timer = expired;
+    expired = timer->next;
+    t = timer->data;
+    if (__atomic_exchange_n(&t->wait_state, 0, __ATOMIC_SEQ_CST) == 0) continue;
+    *tail = timer;
+    tail = &timer->next;
+  }
+  *tail = NULL;
+  timer_lock_release();
+  if (woken == NULL) return;
+
+  for (timer = woken; timer != NULL; timer = timer->next) {
+    t = timer->data;
+    t->wait_result = -1;
+    if (t->wait_queue != NULL) {
+      wait_lock(t->wait_lock);
+      tcb_queue_find_remove(t->wait_queue, t);
+      wait_unlock(t->wait_lock);
+    }
+  }
+
+  stamp = stats_now();
+  worker_lock(w);
+  while (woken != NULL) {
+    timer = woken;
+    //Once t is queued it can run and sleep again in another worker
+    woken = timer->next;
+    t = timer->data;
+    t->state = INIT;
+    account_wake(t, stamp);
+    policy->on_wake(w->rq, t);
+    trace_event(TRACE_READY, TRACE_TIMER, t->tid, t->priority, -1, w->id);
+  }
+  worker_unlock(w);
+  wake_idle_worker();
+}
+
+/* Prints the idle time and the utilization of the workers since the library was initialized */
+static void idle_report(FILE *out)
+{
+  long long total;
+
+  total = (clock_now() - start_time) * num_workers;
+  fprintf(out, "*** IDLE: %.3f s of %.3f s (utilization %.1f%%)\n", idle_nsec / 1e9, total / 1e9,
+          total > 0 ? 100.0 * (total - idle_nsec) / total : 0.0);
+}
+
+/* Take a ready thread from another worker, NULL if all of them are empty */
+static TCB* steal(struct worker *w)
+{
+  struct worker *victim;
+  TCB *t = NULL;
+  int i;
+
+  for (i = 1; i < num_workers && t == NULL; i++) {
+    victim = &workers[(w->id + i) % num_workers];
+    pthread_spin_lock(&victim->lock);
+    t = policy->pick_next(victim->rq);
+    pthread_spin_unlock(&victim->lock);
+  }
+  //A thread preempted in the victim is queued before its context is saved (see scheduler)
+  while (t != NULL && __atomic_load_n(&t->switching, __ATOMIC_ACQUIRE));
+  return t;
+}
+
+/* Ticks until the scheduler may have to preempt t, the thread running in w, or 0 if
+   only its end matters and it has none. Used to program the timer in tickless mode.
+   Called with the worker locked */
+static int next_decision(struct worker *w, TCB *t)
+{
+  int n = t->remaining_ticks > 0 ? t->remaining_ticks : 0;
+  int p = policy->next_tick(w->rq, t);
+  long timer = __atomic_load_n(&timer_next, __ATOMIC_ACQUIRE);
+
+  if (p > 0 && (n == 0 || p < n)) n = p;
+  //A sleeping thread may have to wake up before
+  if (timer != LONG_MAX) {
+    timer -= wheel_now();
+    if (timer < 1) timer = 1;
+    if (n == 0 || timer < n) n = timer;
+  }
+  return n;
+}
+
+/* Tickless mode: arm the timer for the next decision on the running thread of w */
+static void program_tick(struct worker *w)
+{
+  int n;
+
+  if (w->running == &w->idle) {
+    arm_next_tick(0);
+    return;
+  }
+  worker_lock(w);
+  n = next_decision(w, w->running);
+  worker_unlock(w);
+  arm_next_tick(n);
+}
 
-/* Thread control block for the idle thread */
-static TCB idle;
+/* A joinable thread has finished: it is EXITED from now on, and its joiner is resumed */
+static void exit_joinable(TCB *t)
+{
+  TCB *joiner;
+
+  wait_lock(&t->join_lock);
+  t->state = EXITED;
+  joiner = t->joiner;
+  wait_unlock(&t->join_lock);
+  //It waits with no timeout, nobody else can take it
+  if (joiner != NULL && wait_claim(joiner)) wait_resume(joiner);
+}
 
+/* Run by the resumed context after every context switch, with the interrupts blocked */
+static void finish_switch()
+{
+  struct worker *w = this_worker();
+  void (*park_unlock)(void *);
+  TCB *dead;
+  int joinable;
+
+  if (w->requeue != NULL) {
+    //It was picked again: it goes on running. Otherwise another worker can run it from now on
+    if (w->requeue != w->running) {
+      __atomic_store_n(&w->requeue->switching, 0, __ATOMIC_RELEASE);
+      wake_idle_worker();
+    }
+    w->requeue = NULL;
+  }
+  if (w->block != NULL) {
+    //From now on a disk interrupt can resume it, in any worker. The thread waiting is the
+    //one of the request, the completion finds it there
+    disk_submit(w->block_io);
+    w->block = NULL;
+    w->block_io = NULL;
+  }
+  if (w->timed != NULL) {
+    //From now on its timer can resume it, in any worker
+    timer_lock_acquire();
+    wheel_add(&timers, &w->timed->timer, w->timed->timer.expires);
+    __atomic_store_n(&timer_next, wheel_next_event(&timers), __ATOMIC_RELEASE);
+    timer_lock_release();
+    w->timed = NULL;
+  }
+  if (w->dead != NULL) {
+    dead = w->dead;
+    w->dead = NULL;
+    if (dead->priority == REALTIME && policy->leave != NULL) policy->leave(&dead->rt);
+    account_exit(dead);
+    //A joinable one keeps its TCB until it is joined (see mythread_join)
+    store_lock_acquire();
+    stack_free(dead->stack, dead->stack_size);
+    dead->stack = NULL;
+    joinable = dead->joinable;
+    if (!joinable) tcb_release(dead);
+    store_lock_release();
+    //Not dead->joinable: once released, the TCB may be reused by a new thread already
+    if (joinable) exit_joinable(dead);
+  }
+  if (w->park_unlock != NULL) {
+    //From now on a waker can take it from its wait queue. The lock was taken before the
+    //interrupts were blocked, a clock interrupt deferred meanwhile runs when it is released
+    //and may switch again: this one is done by then
+    park_unlock = w->park_unlock;
+    w->park_unlock = NULL;
+    park_unlock(w->park_arg);
+  }
+  program_tick(this_worker());
+}
+
+
+/* 1:N idle thread: waits for a disk interrupt, or for the next timer to be due */
+static void idle_wait(sigset_t *wait_mask)
+{
+  long next = __atomic_load_n(&timer_next, __ATOMIC_ACQUIRE);
+  struct timespec now, timeout;
+  long long nsec;
+
+  //Simulation: straight to the next timer or disk interrupt
+  if (simulation) {
+    if (wait_virtual(next == LONG_MAX ? LLONG_MAX : (long long) next * tick_length()) < 0) {
+      printf("*** ERROR: the simulation is stuck, every thread waits for another one\n");
+      exit(-1);
+    }
+    return;
+  }
+  if (next == LONG_MAX) {
+    sigsuspend(wait_mask);
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  nsec = (long long) next * tick_length() - (now.tv_sec * 1000000000LL + now.tv_nsec);
+  if (nsec <= 0) return;
+  timeout.tv_sec = nsec / 1000000000LL;
+  timeout.tv_nsec = nsec % 1000000000LL;
+  //sigsuspend() with a timeout
+  ppoll(NULL, 0, &timeout, wait_mask);
+}
+
+/* M:N idle thread: sleeps until a thread is made ready (idle_seq moves from seq), a disk
+   interrupt comes, or the next timer is due */
+static void idle_park(int seq, sigset_t *wait_mask)
+{
+  long next = __atomic_load_n(&timer_next, __ATOMIC_ACQUIRE);
+  struct timespec timeout, *ts = NULL;
+  sigset_t block_mask;
+  long long nsec;
+
+  if (next != LONG_MAX) {
+    nsec = (long long) next * tick_length() - clock_now();
+    if (nsec <= 0) return;
+    timeout.tv_sec = nsec / 1000000000LL;
+    timeout.tv_nsec = nsec % 1000000000LL;
+    ts = &timeout;
+  }
+  //A disk interrupt taken in between bumps idle_seq, then the futex does not wait
+  sigprocmask(SIG_SETMASK, wait_mask, &block_mask);
+  syscall(SYS_futex, &idle_seq, FUTEX_WAIT_PRIVATE, seq, ts, NULL, 0);
+  sigprocmask(SIG_SETMASK, &block_mask, NULL);
+}
+
+
+/* Runs when no thread is ready, with the interrupts blocked: it switches to a ready thread
+   by itself. In 1:N mode only a disk interrupt or a timer can make a thread ready, so it
+   sleeps until one comes instead of spinning. In M:N mode a thread made ready by another
+   worker can also be stolen, that worker wakes it up (see wake_idle_worker) */
 static void idle_function()
 {
-  while(1);
+  struct worker *w;
+  TCB *next;
+  sigset_t wait_mask;
+  long long from;
+  int seq = 0;
+
+  block_interrupts();
+  sigprocmask(SIG_BLOCK, NULL, &wait_mask);
+  sigdelset(&wait_mask, SIGPROF);
+
+  from = clock_now();
+  while(1) {
+    //Counted before looking at the queues: a thread made ready after that wakes it up
+    if (num_workers > 1) {
+      __atomic_add_fetch(&idle_sleepers, 1, __ATOMIC_SEQ_CST);
+      seq = __atomic_load_n(&idle_seq, __ATOMIC_SEQ_CST);
+    }
+    //The clock interrupt does not come while the idle thread runs
+    expire_timers(this_worker());
+    next = scheduler();
+    w = this_worker();
+    if (next == &w->idle) {
+      //The queues are checked with the disk interrupt blocked, so it can not be lost before sleeping
+      if (num_workers == 1) idle_wait(&wait_mask);
+      else {
+        idle_park(seq, &wait_mask);
+        __atomic_sub_fetch(&idle_sleepers, 1, __ATOMIC_SEQ_CST);
+      }
+      continue;
+    }
+    if (num_workers > 1) __atomic_sub_fetch(&idle_sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&idle_nsec, clock_now() - from, __ATOMIC_RELAXED);
+    w->idle.state = IDLE;
+    w->old_running = &w->idle;
+    w->running = next;
+    next->state = RUNNING;
+    activator(next);
+    from = clock_now();
+  }
+}
+
+/* Entry point of every thread context: runs the thread body with its argument */
+static void thread_start(void *arg)
+{
+  TCB *t = arg;
+
+  //Contexts are made with the interrupts blocked, they are enabled once the switch is done
+  finish_switch();
+  unblock_interrupts();
+  if (t->start != NULL) t->retval = t->start(t->start_arg);
+  else t->function(t->arg);
+  mythread_exit();
 }
 
 void function_thread(int sec)
 {
     //time_t end = time(NULL) + sec;
-    while(running->remaining_ticks)
+    while(this_worker()->running->remaining_ticks)
     {
       //do something
+      if (simulation) run_virtual(tick_length());
     }
     mythread_exit();
 }
 
 
+/* Kernel thread of the workers other than 0. Its idle thread runs on the kernel thread stack */
+static void *worker_main(void *arg)
+{
+  struct worker *w = arg;
+
+  self = w;
+  w->running = &w->idle;
+  init_thread_interrupt();
+  idle_function();
+  return NULL;
+}
+
+
+/* Set the number of workers (kernel threads) that run the threads. n <= 0 means one per core.
+   It must be called before any other function of the library, returns -1 otherwise */
+int mythread_set_workers(int n)
+{
+  if (init) return -1;
+  if (n <= 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n <= 0) n = 1;
+  num_workers = n;
+  return n;
+}
+
+
+/* Simulation mode: the ticks, the disk and the timers run on a virtual clock moved by the
+   library instead of signals (see set_virtual_clock), with one worker. The threads take
+   virtual time only with mythread_burn(), and the gaps where all of them wait take none.
+   The same program gives the same execution every time, faster than real time.
+   Also with $MYTHREAD_SIM=1. It must be called before any other function of the
+   library, returns -1 otherwise */
+int mythread_set_simulation(int on)
+{
+  if (init) return -1;
+  simulation = on;
+  return 0;
+}
+
+
+/* Set the scheduling policy by name ("rr", "rrs", "rrsd", "cfs", "mlfq", "edf" or "prio", see policy.c).
+   It must be called before any other function of the library, returns -1 otherwise and
+   -2 if there is no such policy. By default it is $MYTHREAD_POLICY, or "rrs" */
+int mythread_set_policy(const char *name)
+{
+  struct sched_policy *p;
+
+  if (init) return -1;
+  p = policy_find(name);
+  if (p == NULL) return -2;
+  policy = p;
+  return 0;
+}
+
+
 /* Initialize the thread library */
 void init_mythreadlib()
 {
+  struct worker *w;
+  char *name;
   int i;
 
-  /* Initialize both queues*/
-   high_ready_list= queue_new  ();
-   low_ready_list = queue_new();
-
-  /* Create context for the idle thread */
-  if(getcontext(&idle.run_env) == -1)
-  {
-    perror("*** ERROR: getcontext in init_thread_lib");
-    exit(-1);
+  if (policy == NULL) {
+    name = getenv("MYTHREAD_POLICY");
+    if (name == NULL || *name == '\0') name = "rrs";
+    policy = policy_find(name);
+    if (policy == NULL) {
+      printf("*** ERROR: unknown scheduling policy %s\n", name);
+      exit(-1);
+    }
   }
 
-  idle.state = IDLE;
-  idle.priority = SYSTEM;
-  idle.function = idle_function;
-  idle.run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
-  idle.tid = -1;
+  //Only turns the printf sink on, trace_print() may have done it already
+  name = getenv("MYTHREAD_TRACE_PRINT");
+  if (name != NULL && atoi(name) > 0) trace_print(1);
 
-  if(idle.run_env.uc_stack.ss_sp == NULL)
-  {
-    printf("*** ERROR: thread failed to get stack space\n");
-    exit(-1);
+  name = getenv("MYTHREAD_SIM");
+  if (name != NULL && atoi(name) > 0) simulation = 1;
+  if (simulation) {
+    num_workers = 1;
+    set_virtual_clock();
   }
 
-  idle.run_env.uc_stack.ss_size = STACKSIZE;
-  idle.run_env.uc_stack.ss_flags = 0;
-  idle.ticks = QUANTUM_TICKS;
-  makecontext(&idle.run_env, idle_function, 1);
-
-  t_state[0].state = INIT;
-  t_state[0].priority = LOW_PRIORITY;
-  t_state[0].ticks = QUANTUM_TICKS;
+  //Contexts are made with the interrupts blocked (see thread_start)
+  block_interrupts();
 
-  if(getcontext(&t_state[0].run_env) == -1)
+  workers = calloc(num_workers, sizeof(struct worker));
+  if (workers == NULL)
   {
-    perror("*** ERROR: getcontext in init_thread_lib");
-    exit(5);
+    printf("*** ERROR: failed to allocate the workers\n");
+    exit(-1);
   }
+  pthread_spin_init(&store_lock, PTHREAD_PROCESS_PRIVATE);
+  pthread_spin_init(&timer_lock, PTHREAD_PROCESS_PRIVATE);
+  wheel_init(&timers, wheel_now());
+
+  for (i = 0; i < num_workers; i++) {
+    w = &workers[i];
+    w->id = i;
+    w->rq = policy->init();
+    pthread_spin_init(&w->lock, PTHREAD_PROCESS_PRIVATE);
+
+    w->idle.state = IDLE;
+    w->idle.priority = SYSTEM;
+    w->idle.function = idle_function;
+    w->idle.tid = -1;
+    w->idle.ticks = QUANTUM_TICKS;
+  }
+
+  /* The main kernel thread is the worker 0, its idle thread needs a stack */
+  w = &workers[0];
+  self = w;
+  w->idle.stack_size = stack_round(STACKSIZE);
+  w->idle.stack = stack_alloc(w->idle.stack_size);
 
-  for(i = 1; i < N; i++)
+  if(w->idle.stack == NULL)
   {
-    t_state[i].state = FREE;
+    printf("*** ERROR: thread failed to get stack space\n");
+    exit(-1);
   }
 
-  t_state[0].tid = 0;
-  running = &t_state[0];
+  /* Create context for the idle thread */
+  mctx_make(&w->idle.run_env, w->idle.stack, w->idle.stack_size, thread_start, &w->idle);
+
+  /* The main thread takes the first slot (tid 0) */
+  w->running = tcb_alloc();
+  w->running->state = INIT;
+  w->running->priority = LOW_PRIORITY;
+  w->running->ticks = QUANTUM_TICKS;
+  w->running->nice = 0;
+  w->running->vruntime = 0;
+  w->running->vruntime_rem = 0;
+  w->running->level = -1;
+  wheel_timer_init(&w->running->timer, w->running);
+  /* The main thread runs on the process stack, not on a pool one.
+     Its context is saved the first time it is switched out */
+  w->running->stack = NULL;
+  live_threads = 1;
+
+  start_time = clock_now();
+  stats_init(simulation);
+  w->running->acct_since = stats_now();
 
   /* Initialize disk and clock interrupts */
   init_disk_interrupt();
+  if (policy->blocking_io && simulation) disk_init_simulated();
+  else if (policy->blocking_io) disk_init(DISK_HELPERS);
+  //One tick timer per worker (see init_thread_interrupt)
   init_interrupt();
+  for (i = 1; i < num_workers; i++) {
+    if (pthread_create(&workers[i].kthread, NULL, worker_main, &workers[i]) != 0) {
+      perror("*** ERROR: failed to create the worker");
+      exit(-1);
+    }
+  }
+
+  unblock_interrupts();
 }
 
 
 /* Create and intialize a new thread with body fun_addr and one integer argument */
 int mythread_create (void (*fun_addr)(), int priority, int seconds)
 {
+  return mythread_create_stack(fun_addr, priority, seconds, STACKSIZE);
+}
+
+
+/* Creates a thread that runs for total_ticks (0: until it exits), rt is NULL unless
+   it is a deadline thread. The body is fun_addr(arg), or start(start_arg) for a
+   joinable thread (start != NULL) */
+static int create_thread(void (*fun_addr)(), int priority, int total_ticks, int arg, int stack_size,
+                         struct rt_params *rt, void *(*start)(void *), void *start_arg)
+{
+  struct worker *w;
+  TCB *t;
+  void *stack = NULL;
+  size_t size;
   int i;
 
+  if (stack_size <= 0) stack_size = STACKSIZE;
+  size = stack_round(stack_size);
+
+  /* O(1): take a slot from the free list of the tcb_store */
+  block_interrupts();
+  store_lock_acquire();
+  t = tcb_alloc();
+  if (t != NULL) stack = stack_alloc(size);
+  store_lock_release();
+
+  /* Every run queue must fit every thread, so the interrupt handlers never allocate */
+  for (i = 0; t != NULL && i < num_workers; i++) {
+    worker_lock(&workers[i]);
+    policy->reserve(workers[i].rq, tcb_capacity());
+    worker_unlock(&workers[i]);
+  }
+
+  if (t == NULL) {
+    unblock_interrupts();
+    return(-1);
+  }
+
+  t->state = INIT;
+  t->priority = priority;
+  t->function = fun_addr;
+  t->execution_total_ticks = total_ticks;
+  t->ticks = QUANTUM_TICKS;
+  t->remaining_ticks = t->execution_total_ticks;
+  t->nice = 0;
+  t->vruntime = 0;
+  t->vruntime_rem = 0;
+  t->level = -1;
+  wheel_timer_init(&t->timer, t);
+  if (rt != NULL) t->rt = *rt;
+  t->stack = stack;
+
+  if(t->stack == NULL)
+  {
+    printf("*** ERROR: thread failed to get stack space\n");
+    exit(-1);
+  }
+
+  t->stack_size = size;
+  t->arg = arg;
+  t->start = start;
+  t->start_arg = start_arg;
+  t->retval = NULL;
+  t->joinable = start != NULL;
+  t->joiner = NULL;
+  memset(&t->acct, 0, sizeof(t->acct));
+  //Ready from now on
+  t->acct_since = stats_now();
+  mctx_make(&t->run_env, t->stack, t->stack_size, thread_start, t);
+  __atomic_add_fetch(&live_threads, 1, __ATOMIC_SEQ_CST);
+
+  //We introduce the newly created thread in the run queue of this worker
+  w = this_worker();
+  worker_lock(w);
+  policy->enqueue(w->rq, t);
+  worker_unlock(w);
+  wake_idle_worker();
+  //The new thread may compete with the running one
+  program_tick(w);
+
+  unblock_interrupts();
+
+  return t->tid;
+}
+
+
+/* Same as mythread_create() with a stack of stack_size bytes (rounded to the pool size classes) */
+int mythread_create_stack (void (*fun_addr)(), int priority, int seconds, int stack_size)
+{
   if (!init) { init_mythreadlib(); init = 1;}
 
   if (priority == SYSTEM) {
     // Return errno -2 when a user tries to create a SYSTEM thread
     return -2;
 
-  } else if (priority != HIGH_PRIORITY && priority != LOW_PRIORITY) {
+  } else if (priority < LOW_PRIORITY || priority > policy->max_priority) {
     // Return errno -3 when a user tries to create a thread with a not defined priority
     return -3;
   }
+  return create_thread(fun_addr, priority, seconds_to_ticks(seconds), seconds, stack_size, NULL, NULL, NULL);
+}
 
-  for (i = 0; i < N; i++)
-    if (t_state[i].state == FREE) break;
 
-  if (i == N) return(-1);
+/* Default attributes of mythread_spawn() */
+void mythread_attr_init(mythread_attr_t *attr)
+{
+  attr->stack_size = STACKSIZE;
+  attr->priority = LOW_PRIORITY;
+  attr->seconds = 0;
+  attr->budget_ticks = 0;
+}
 
-  if(getcontext(&t_state[i].run_env) == -1)
-  {
-    perror("*** ERROR: getcontext in my_thread_create");
-    exit(-1);
+
+/* Create a joinable thread that runs fn(arg), with the attributes attr (NULL: the defaults
+   of mythread_attr_init()). Its TCB is kept once it finishes, until mythread_join() takes
+   what fn returned. Returns the tid, or the errors of mythread_create_stack() */
+int mythread_spawn(void *(*fn)(void *), void *arg, const mythread_attr_t *attr)
+{
+  mythread_attr_t defaults;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+
+  if (attr == NULL) {
+    mythread_attr_init(&defaults);
+    attr = &defaults;
   }
+  if (attr->priority == SYSTEM) return -2;
+  if (attr->priority < LOW_PRIORITY || attr->priority > policy->max_priority || attr->seconds < 0 ||
+      attr->budget_ticks < 0) return -3;
+  return create_thread(NULL, attr->priority,
+                       attr->budget_ticks > 0 ? attr->budget_ticks : seconds_to_ticks(attr->seconds),
+                       attr->seconds, attr->stack_size, NULL, fn, arg);
+}
 
-  t_state[i].state = INIT;
-  t_state[i].priority = priority;
-  t_state[i].function = fun_addr;
-  t_state[i].execution_total_ticks = seconds_to_ticks(seconds);
-  t_state[i].ticks = QUANTUM_TICKS;
-  t_state[i].remaining_ticks = t_state[i].execution_total_ticks;
-  t_state[i].run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
 
-  if(t_state[i].run_env.uc_stack.ss_sp == NULL)
-  {
-    printf("*** ERROR: thread failed to get stack space\n");
-    exit(-1);
+/* Create a deadline thread, scheduled before every other one by the edf policy.
+   Every job runs for at most runtime ticks and must be done deadline ticks after its
+   release (deadline 0: the period). With period 0 there is one job and the thread ends
+   when it runs out of budget. Otherwise a job is released every period ticks: a thread
+   that runs out of budget waits for the next release, and its waiting counts as blocked.
+   Returns -3 for invalid parameters, -4 if the policy has no deadline threads and -5 if
+   the thread does not pass the admission control */
+int mythread_create_deadline (void (*fun_addr)(), int runtime, int deadline, int period)
+{
+  struct rt_params rt;
+  int tid;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+
+  if (deadline == 0) deadline = period;
+  if (runtime <= 0 || deadline <= 0 || period < 0 || runtime > deadline) return -3;
+  if (policy->admit == NULL) return -4;
+  if (policy->admit(runtime, deadline, period) < 0) return -5;
+
+  memset(&rt, 0, sizeof(rt));
+  rt.runtime = runtime;
+  rt.deadline = deadline;
+  rt.period = period;
+  rt.budget = runtime;
+  rt.abs_deadline = -1;
+  tid = create_thread(fun_addr, REALTIME, period == 0 ? runtime : 0, runtime, STACKSIZE, &rt, NULL, NULL);
+  //Its share of the CPU is given back
+  if (tid < 0) policy->leave(&rt);
+  return tid;
+}
+/****** End my_thread_create() ******/
+
+
+/* Read disk syscall: reads len bytes of fd at offset into buf, as pread().
+   With a blocking_io policy the data that is not in the page cache is read by a disk
+   helper: the thread waits for the disk interrupt of its own read and the worker runs
+   another one meanwhile. Otherwise the worker waits for the disk.
+   Returns the bytes read, or -1 and errno */
+ssize_t read_disk(int fd, off_t offset, void *buf, size_t len)
+{
+  struct disk_request r;
+  struct iovec iov = { buf, len };
+  struct worker *w;
+  ssize_t n;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+  if (!policy->blocking_io && simulation) {
+    //The worker waits for the disk, the clock goes on with nothing running
+    block_interrupts();
+    wait_virtual(clock_now() + DISK_SIM_SEEK + (long long) len * DISK_SIM_BYTE);
+    unblock_interrupts();
+  }
+  if (!policy->blocking_io) return pread(fd, buf, len, offset);
+
+  //Data in the page cache. It can be only a part of it, the rest is read by a helper.
+  //Not in a simulation: what is cached changes from one execution to the next
+  n = 0;
+  if (!simulation) {
+    n = preadv2(fd, &iov, 1, offset, RWF_NOWAIT);
+    if (n == 0 || n == len) return n;
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EOPNOTSUPP) return -1;
+      n = 0;
+    }
+  }
+
+  r.fd = fd;
+  r.offset = offset + n;
+  r.buf = (char *) buf + n;
+  r.len = len - n;
+
+  /* The switch is done with the interrupts blocked, they are unblocked again when the
+     thread resumes since it may be resumed from an interrupt handler (see context.h) */
+  block_interrupts();
+  w = this_worker();
+  w->old_running = w->running;
+  w->old_running->state = WAITING;
+  worker_lock(w);
+  policy->on_block(w->rq, w->old_running, TRACE_IO);
+  worker_unlock(w);
+  //Its read is submitted once its context is saved (see finish_switch)
+  r.thread = w->old_running;
+  w->block = w->old_running;
+  w->block_io = &r;
+  w->wait_reason = TRACE_IO;
+  trace_event(TRACE_WAIT, TRACE_IO, w->old_running->tid, w->old_running->priority, -1, w->id);
+
+  w->running = scheduler();
+  w->running->state = RUNNING;
+  activator(w->running);
+  unblock_interrupts();
+
+  if (r.result < 0) {
+    errno = r.error;
+    return n > 0 ? n : -1;
+  }
+  return n + r.result;
+}
+
+/* Disk interrupt: every thread whose read is done is ready again, in this worker.
+   The completed reads are taken as one batch, each one with its waiting thread, and
+   queued in one critical section of the run queue: O(1) per read */
+void disk_interrupt(int sig)
+{
+  struct worker *w = this_worker();
+  struct disk_request *r, *batch;
+  TCB *t, *woken = NULL, **tail = &woken;
+  long long now;
+  int n;
+
+  batch = disk_completed(&n);
+  if (batch == NULL) return;
+
+  //Linked through next, in completion order: r is on the stack of the thread and is gone once it runs
+  for (r = batch; r != NULL; r = r->next) {
+    *tail = r->thread;
+    tail = &r->thread->next;
+  }
+  *tail = NULL;
+
+  now = stats_now();
+  worker_lock(w);
+  while (woken != NULL) {
+    t = woken;
+    woken = t->next;
+    t->next = NULL;
+    t->state = INIT;
+    account_wake(t, now);
+    policy->on_wake(w->rq, t);
+    trace_event(TRACE_READY, TRACE_IO, t->tid, t->priority, -1, w->id);
+  }
+  worker_unlock(w);
+  wake_idle_worker();
+  //The woken threads may compete with the running one
+  program_tick(w);
+}
+
+
+/* Keeps the calling thread busy for nsec ns of its own run time, preempted as any other
+   one meanwhile. In a simulation this is how a thread takes time: the virtual clock
+   moves and the interrupts due are taken on the way */
+void mythread_burn(long long nsec)
+{
+  TCB *t;
+  long long end;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+  if (nsec <= 0) return;
+  if (simulation) {
+    run_virtual(nsec);
+    return;
   }
+  //Its run time is charged at every switch (see account_switch), in stats_now() units
+  t = this_worker()->running;
+  end = __atomic_load_n(&t->acct.run_ns, __ATOMIC_RELAXED) + stats_now() -
+        __atomic_load_n(&t->acct_since, __ATOMIC_RELAXED) + (long long) (nsec / stats_scale());
+  while (__atomic_load_n(&t->acct.run_ns, __ATOMIC_RELAXED) + stats_now() -
+         __atomic_load_n(&t->acct_since, __ATOMIC_RELAXED) < end);
+}
+
+
+/* Sleeps the calling thread for at least nsec nanoseconds, the worker runs other threads
+   meanwhile. Its timer expires at the first clock interrupt (or idle wake up) after that,
+   so the resolution is the length of the tick. Returns 0, or -1 if nsec is negative */
+int mythread_sleep(long long nsec)
+{
+  struct worker *w;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+  if (nsec < 0) return -1;
+  if (nsec == 0) return 0;
+
+  /* As read_disk(), the switch is done with the interrupts blocked */
+  block_interrupts();
+  w = this_worker();
+  w->old_running = w->running;
+  w->old_running->state = WAITING;
+  w->old_running->timer.expires = timeout_tick(nsec);
+  w->old_running->wait_queue = NULL;
+  w->old_running->wait_state = 2;
+  worker_lock(w);
+  policy->on_block(w->rq, w->old_running, TRACE_TIMER);
+  worker_unlock(w);
+  //It goes to the timer wheel once its context is saved (see finish_switch)
+  w->timed = w->old_running;
+  w->wait_reason = TRACE_TIMER;
+  trace_event(TRACE_WAIT, TRACE_TIMER, w->old_running->tid, w->old_running->priority, -1, w->id);
+
+  w->running = scheduler();
+  w->running->state = RUNNING;
+  activator(w->running);
+  unblock_interrupts();
+  return 0;
+}
 
-  t_state[i].tid = i;
-  t_state[i].run_env.uc_stack.ss_size = STACKSIZE;
-  t_state[i].run_env.uc_stack.ss_flags = 0;
-  makecontext(&t_state[i].run_env, fun_addr,2,seconds);
-  TCB *padentro = &t_state[i];
+
+/* Lock of a wait queue. The interrupts are deferred while it is held, a thread spinning
+   on it can only be in another worker */
+void wait_lock(int *lock)
+{
   disable_interrupt();
   disable_disk_interrupt();
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED));
+}
 
-  //We introduce the newly created thread in the corresponding queue
-  // High priority: inserted sorted according to the total execution time (SJF)
-  // Low priority: inserted according to arrival order (FIFO)
-  if (t_state[i].priority == HIGH_PRIORITY) sorted_enqueue(high_ready_list,padentro, t_state[i].execution_total_ticks);
-  else enqueue(low_ready_list,padentro);
-
+void wait_unlock(int *lock)
+{
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
   enable_disk_interrupt();
   enable_interrupt();
+}
+
 
-  return i;
+static void park_unlock_one(void *lock)
+{
+  wait_unlock(lock);
 }
-/****** End my_thread_create() ******/
 
+/* Parks the calling thread, on the wait queue q with lock lock or wherever the caller
+   linked it (q == NULL). unlock(arg) releases the locks, see wait.h */
+static int park(struct tcb_queue *q, int *lock, void (*unlock)(void *), void *arg, long long nsec)
+{
+  struct worker *w;
+  TCB *t;
 
-/* Read disk syscall */
-int read_disk()
+  if (nsec == 0) {
+    unlock(arg);
+    return -1;
+  }
+
+  /* As read_disk(), the switch is done with the interrupts blocked */
+  block_interrupts();
+  w = this_worker();
+  t = w->running;
+  w->old_running = t;
+  t->state = WAITING;
+  t->wait_result = 0;
+  t->wait_queue = q;
+  t->wait_lock = lock;
+  __atomic_store_n(&t->wait_state, nsec > 0 ? 2 : 1, __ATOMIC_SEQ_CST);
+  if (q != NULL) tcb_enqueue(q, t);
+  worker_lock(w);
+  policy->on_block(w->rq, t, TRACE_SYNC);
+  worker_unlock(w);
+  //Its timer is armed and the lock released once its context is saved (see finish_switch)
+  if (nsec > 0) {
+    t->timer.expires = timeout_tick(nsec);
+    w->timed = t;
+  }
+  w->park_unlock = unlock;
+  w->park_arg = arg;
+  w->wait_reason = TRACE_SYNC;
+  trace_event(TRACE_WAIT, TRACE_SYNC, t->tid, t->priority, -1, w->id);
+
+  w->running = scheduler();
+  w->running->state = RUNNING;
+  activator(w->running);
+  unblock_interrupts();
+  return t->wait_result;
+}
+
+
+/* Parks the calling thread on the wait queue q, see wait.h */
+int wait_park(struct tcb_queue *q, int *lock, long long nsec)
 {
-   return 1;
+  return park(q, lock, park_unlock_one, lock, nsec);
 }
 
-/* Disk interrupt  */
-void disk_interrupt(int sig)
+int wait_park_unlock(void (*unlock)(void *), void *arg, long long nsec)
+{
+  return park(NULL, NULL, unlock, arg, nsec);
+}
+
+
+int wait_claim(TCB *t)
+{
+  int state = __atomic_exchange_n(&t->wait_state, 0, __ATOMIC_SEQ_CST);
+
+  //The ones whose timer took them first are made ready by the timer
+  if (state == 0) return 0;
+  if (state == 2) {
+    timer_lock_acquire();
+    wheel_del(&timers, &t->timer);
+    __atomic_store_n(&timer_next, wheel_next_event(&timers), __ATOMIC_RELEASE);
+    timer_lock_release();
+  }
+  t->wait_result = 0;
+  return 1;
+}
+
+TCB* wait_dequeue(struct tcb_queue *q)
+{
+  TCB *t;
+
+  while ((t = tcb_dequeue(q)) != NULL)
+    if (wait_claim(t)) return t;
+  return NULL;
+}
+
+
+void wait_resume(TCB *t)
 {
+  struct worker *w;
 
+  //It is not preempted (and moved to another worker) in between
+  disable_interrupt();
+  w = this_worker();
+  worker_lock(w);
+  t->state = INIT;
+  account_wake(t, stats_now());
+  policy->on_wake(w->rq, t);
+  trace_event(TRACE_READY, TRACE_SYNC, t->tid, t->priority, -1, w->id);
+  worker_unlock(w);
+  wake_idle_worker();
+  //The resumed thread may compete with the running one
+  program_tick(w);
+  enable_interrupt();
 }
 
 
 /* Free terminated thread and exits */
 void mythread_exit() {
-  old_running = running;
-  int tid = old_running->tid;
-  t_state[tid].state = FREE;
-  free(t_state[tid].run_env.uc_stack.ss_sp);
-  running = scheduler();
+  struct worker *w;
+
+  /* Every context switch is done with the interrupts blocked (see context.h) */
+  block_interrupts();
+  w = this_worker();
+  w->old_running = w->running;
+  w->old_running->state = FREE;
+  //Its stack is in use until the switch, the next thread releases it
+  w->dead = w->old_running;
+  __atomic_sub_fetch(&live_threads, 1, __ATOMIC_SEQ_CST);
+  w->running = scheduler();
 
   //Scheduler() can finish the execution of the problem, so we might not come here
-  running->state = RUNNING;
+  w->running->state = RUNNING;
 
   //Swap context to next thread
-  activator(running);
+  activator(w->running);
 }
 
 
-void mythread_timeout(int tid) {
-
-    printf("*** THREAD %d EJECTED\n", tid);
-    t_state[tid].state = FREE;
-    free(t_state[tid].run_env.uc_stack.ss_sp);
+/* Wait for the joinable thread tid to finish, and release its TCB: tid is not valid any
+   more, a new thread in the same slot gets another one (see tcb_store.h).
+   ret (if not NULL) gets what its body returned, NULL if it called mythread_exit() or ran
+   out of time. The caller is parked meanwhile.
+   Returns -1 if tid is not a joinable thread, -2 if another thread joins it and -3 if
+   it is the caller */
+int mythread_join(int tid, void **ret)
+{
+  TCB *t, *me;
 
-    TCB* next = scheduler();
-    activator(next);
+  if (!init) { init_mythreadlib(); init = 1;}
+  me = tcb_get(mythread_gettid());
+  //Looked up and locked under the store lock: another joiner cannot release it meanwhile
+  block_interrupts();
+  store_lock_acquire();
+  t = tcb_get(tid);
+  if (t != NULL && t != me) wait_lock(&t->join_lock);
+  store_lock_release();
+  unblock_interrupts();
+  if (t == NULL) return -1;
+  if (t == me) return -3;
+
+  if (!t->joinable) {
+    wait_unlock(&t->join_lock);
+    return -1;
+  }
+  if (t->joiner != NULL) {
+    wait_unlock(&t->join_lock);
+    return -2;
+  }
+  t->joiner = me;
+  //Resumed by the thread that runs after it finishes (see exit_joinable)
+  if (t->state != EXITED) park(NULL, NULL, park_unlock_one, &t->join_lock, -1);
+  else wait_unlock(&t->join_lock);
+
+  if (ret != NULL) *ret = t->retval;
+  block_interrupts();
+  store_lock_acquire();
+  t->joinable = 0;
+  tcb_release(t);
+  store_lock_release();
+  unblock_interrupts();
+  return 0;
 }
 
 
 /* Sets the priority of the calling thread */
 void mythread_setpriority(int priority)
 {
-  //Priority can only be set to HIGH or LOW, not SYSTEM or any non defined priority
-  if (priority == LOW_PRIORITY || priority == HIGH_PRIORITY){
+  //Priority can only be set to one of the policy (LOW to HIGH or MAX_PRIORITY), not SYSTEM
+  //or any non defined priority. Deadline threads keep their class, they passed the admission control
+  if (tcb_get(mythread_gettid())->priority == REALTIME) return;
+  if (priority >= LOW_PRIORITY && priority <= policy->max_priority){
     int tid = mythread_gettid();
-    t_state[tid].priority = priority;
+    tcb_get(tid)->priority = priority;
 
-    if(priority ==  HIGH_PRIORITY){
-      t_state[tid].remaining_ticks = 195;
+    //The SJF class gets a time budget, its key. Under the other policies it is only one
+    //more level, with no budget
+    if(priority ==  HIGH_PRIORITY && policy->sjf_budget > 0){
+      tcb_get(tid)->remaining_ticks = policy->sjf_budget;
     }
   }else {
       printf("Invalid priority < %d >", priority);
@@ -231,149 +1260,298 @@ void mythread_setpriority(int priority)
 }
 
 /* Returns the priority of the calling thread */
-int mythread_getpriority(int priority)
+int mythread_getpriority()
 {
   int tid = mythread_gettid();
-  return t_state[tid].priority;
+  return tcb_get(tid)->priority;
+}
+
+
+/* Sets the nice value of the calling thread, its share of the CPU under the cfs policy.
+   Returns -1 if it is out of MIN_NICE..MAX_NICE */
+int mythread_setnice(int nice)
+{
+  if (nice < MIN_NICE || nice > MAX_NICE) return -1;
+  tcb_get(mythread_gettid())->nice = nice;
+  return 0;
+}
+
+/* Returns the nice value of the calling thread */
+int mythread_getnice()
+{
+  return tcb_get(mythread_gettid())->nice;
+}
+
+
+/* Copies the deadline misses of the live deadline thread tid. Returns -1 if there is none */
+int mythread_deadline_stats(int tid, struct mythread_deadline_stats *stats)
+{
+  TCB *t;
+  int ret = -1;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+  block_interrupts();
+  store_lock_acquire();
+  t = tcb_get(tid);
+  if (t != NULL && t->state != FREE && t->priority == REALTIME) {
+    *stats = t->rt.stats;
+    ret = 0;
+  }
+  store_lock_release();
+  unblock_interrupts();
+  return ret;
+}
+
+
+/* Copies the accounting of t in ns, counting the time in its current state until now.
+   scale converts stats_now() units to ns */
+static void stats_snapshot(TCB *t, double scale, struct mythread_stats *stats)
+{
+  long long since = stats_now() - t->acct_since;
+
+  *stats = t->acct;
+  if (t->state == RUNNING) stats->run_ns += since;
+  else if (t->state == INIT) stats->ready_ns += since;
+  else if (t->state == WAITING && t->acct_reason == TRACE_IO) stats->io_ns += since;
+  else if (t->state == WAITING) stats->block_ns += since;
+  stats->run_ns *= scale;
+  stats->ready_ns *= scale;
+  stats->io_ns *= scale;
+  stats->block_ns *= scale;
+}
+
+static void stats_print(FILE *out, const char *who, struct mythread_stats *s)
+{
+  fprintf(out, "*** STATS: %s: run %.3f ms, ready %.3f ms, io %.3f ms, blocked %.3f ms, "
+          "%ld voluntary and %ld involuntary switches, %ld quanta\n", who, s->run_ns / 1e6,
+          s->ready_ns / 1e6, s->io_ns / 1e6, s->block_ns / 1e6, s->voluntary, s->involuntary, s->quanta);
+}
+
+/* Copies the time and the switches of the live thread tid so far, or of a joinable one
+   that was not joined yet. Returns -1 if there is none */
+int mythread_stats(int tid, struct mythread_stats *stats)
+{
+  TCB *t;
+  int ret = -1;
+
+  if (!init) { init_mythreadlib(); init = 1;}
+  block_interrupts();
+  store_lock_acquire();
+  t = tcb_get(tid);
+  if (t != NULL && t->state != FREE) {
+    stats_snapshot(t, stats_scale(), stats);
+    ret = 0;
+  }
+  store_lock_release();
+  unblock_interrupts();
+  return ret;
+}
+
+/* Prints the accounting of every live (or unjoined) thread, then the total of the process:
+   the threads released so far and the ones printed */
+void mythread_stats_report(FILE *out)
+{
+  struct mythread_stats s, total;
+  double scale;
+  char who[32];
+  long threads;
+  int i;
+  TCB *t;
+
+  if (!init) return;
+  //Also printed at FINISH, with the interrupts blocked already
+  disable_interrupt();
+  disable_disk_interrupt();
+  store_lock_acquire();
+  scale = stats_scale();
+  total = acct_total;
+  threads = acct_threads;
+  total.run_ns *= scale;
+  total.ready_ns *= scale;
+  total.io_ns *= scale;
+  total.block_ns *= scale;
+  for (i = 0; i < tcb_capacity(); i++) {
+    t = tcb_slot(i);
+    if (t->state == FREE) continue;
+    stats_snapshot(t, scale, &s);
+    snprintf(who, sizeof(who), "thread %d", t->tid);
+    stats_print(out, who, &s);
+    total.run_ns += s.run_ns;
+    total.ready_ns += s.ready_ns;
+    total.io_ns += s.io_ns;
+    total.block_ns += s.block_ns;
+    total.voluntary += s.voluntary;
+    total.involuntary += s.involuntary;
+    total.quanta += s.quanta;
+    threads++;
+  }
+  store_lock_release();
+  enable_disk_interrupt();
+  enable_interrupt();
+  snprintf(who, sizeof(who), "%ld threads", threads);
+  stats_print(out, who, &total);
+}
+
+
+/* Prints the run queue statistics of the policy, for every worker */
+void mythread_policy_report(FILE *out)
+{
+  int i;
+
+  if (!init || policy->report == NULL) return;
+  for (i = 0; i < num_workers; i++) {
+    if (num_workers > 1) fprintf(out, "*** WORKER %d\n", i);
+    worker_lock(&workers[i]);
+    policy->report(workers[i].rq, out);
+    worker_unlock(&workers[i]);
+  }
+}
+
+/* What the policy sorts the ready threads by, as "high: ..., low: ..." when the
+   priorities are kept apart. NULL before a policy is set */
+const char* mythread_policy_order()
+{
+  return policy == NULL ? NULL : policy->order;
 }
 
 
 /* Get the current thread id.  */
 int mythread_gettid(){
   if (!init) { init_mythreadlib(); init = 1;}
-  return current;
+  return this_worker()->running->tid;
 }
 
 
-/* SJF para alta prioridad, RR para baja */
+/* Next thread to run in this worker, as decided by the policy */
 TCB* scheduler()
 {
+  struct worker *w = this_worker();
+  TCB *process;
 
   disable_interrupt();
   disable_disk_interrupt();
 
-  if (queue_empty(high_ready_list)) {
-    if (queue_empty(low_ready_list)) {
-      //If both queues are empty, we have finish the problem
-      enable_disk_interrupt();
-      enable_interrupt();
-      printf("*** THREAD %d FINISHED\n", old_running->tid);
-      printf("\nFINISH\n");
-      exit(1);
-    }
-
-    //If high-prio queue is empty but low-prio is not, we take the first low-pri thread is returned
-    else {
-      TCB *process = dequeue(low_ready_list);
-      enable_disk_interrupt();
-      enable_interrupt();
-      return process;
-    }
+  worker_lock(w);
+  //The preempted thread competes with the ready ones, it may be picked again
+  if (w->requeue != NULL) {
+    w->requeue->switching = 1;
+    policy->enqueue(w->rq, w->requeue);
   }
+  process = policy->pick_next(w->rq);
+  worker_unlock(w);
+  if (process != NULL && process == w->requeue) process->switching = 0;
 
-  //If there are threads in the high-prio queue
-  else {
-    TCB *process = dequeue(high_ready_list);
-    enable_disk_interrupt();
-    enable_interrupt();
-    return process;
+  //Nothing ready in this worker, look in the others
+  if (process == NULL) process = steal(w);
+
+  enable_disk_interrupt();
+  enable_interrupt();
+
+  if (process != NULL) return process;
+
+  //Threads still alive in other workers, or waiting for the disk
+  if (__atomic_load_n(&live_threads, __ATOMIC_SEQ_CST) > 0) return &w->idle;
+
+  //If all the queues are empty, we have finish the problem (only the first worker reports it)
+  if (__atomic_exchange_n(&finished, 1, __ATOMIC_SEQ_CST)) while(1) pause();
+  trace_event(TRACE_END, TRACE_FINISH, w->old_running->tid, w->old_running->priority, -1, w->id);
+  //The last thread is never released
+  if (w->running != &w->idle && w->running->state == FREE) {
+    account_leave(w->running, stats_now());
+    account_exit(w->running);
   }
+  printf("\nFINISH\n");
+  stack_pool_report(stderr);
+  trace_finish();
+  idle_report(stderr);
+  if (policy->blocking_io) disk_report(stderr);
+  mythread_policy_report(stderr);
+  mythread_stats_report(stderr);
+  exit(1);
 }
 
 
 /* Timer interrupt */
 void timer_interrupt(int sig){
-  running->ticks -= 1;
-  running->remaining_ticks -= 1;
+  struct worker *w = this_worker();
+  TCB *running = w->running;
+  int preempt = 0;
+  int n = elapsed_ticks();
+  long until = 0;
+
+  //The idle thread switches to a ready thread by itself
+  if (running == &w->idle) {
+    arm_next_tick(0);
+    return;
+  }
+
+  //The sleeping threads that are due compete with the running one
+  expire_timers(w);
 
   //IF thread finishes its number of ticks, we end it
-  if(running->remaining_ticks == 0 ){
+  if(running->remaining_ticks > 0 && running->remaining_ticks <= n){
+    trace_event(TRACE_EJECT, TRACE_NONE, running->tid, running->priority, -1, w->id);
     mythread_exit();
   }
 
-  if (!queue_empty(high_ready_list)){//high-prio queue not empty
-    if (running->priority == LOW_PRIORITY){
-      //Save the context of the low priority thread and run the high priority one
-      running->state = INIT;
-      running->ticks = QUANTUM_TICKS;
-      disable_interrupt();
-      disable_disk_interrupt();
-
-      //We store the thread in our queue
-      enqueue(low_ready_list,running);
-      old_running = running;
-
-      //Call for the next thread to come
-      running = scheduler();
-      running->state = RUNNING;
-
-      enable_disk_interrupt();
-      enable_interrupt();
-
-      //Swap context
-      activator(running);
-    }
-    else if (running->priority == HIGH_PRIORITY){
-      /*IF the current high-pri thread needs more time to execute than the first thread in the
-       high_ready_queue (the one with sortest execution time) then the running thread is enqueued and the ready one is set to run
-      */
-      if (running->remaining_ticks > high_ready_list->head->sort){
-        running->state = INIT;
-        running->ticks = QUANTUM_TICKS;
-        disable_interrupt();
-        disable_disk_interrupt();
-
-        //We store the thread in the high-pri queue, sorted by its remaining execution time
-        sorted_enqueue(high_ready_list, running, running->remaining_ticks);
-        old_running = running;
-
-        //Call for the next thread to come
-        running = scheduler();
-        running->state = RUNNING;
-
-        enable_disk_interrupt();
-        enable_interrupt();
-
-        //Swap context
-        activator(running);
-      }
-
-    }
-  }
-  //If high-prio queue is empty
-  //If a low priority thread is running AND its slice ends
-  else if(running->priority == LOW_PRIORITY && running->ticks == 0){
-    //Save the context of the low priority thread and run the high priority one
+  //In tickless mode one interrupt can stand for several ticks
+  if (running->ticks > 0 && running->ticks <= n) running->acct.quanta++;
+  running->ticks -= n;
+  //Only a budget counts down: without one it stays 0, the same SJF key all along
+  if (running->remaining_ticks > 0) running->remaining_ticks -= n;
+
+  worker_lock(w);
+  preempt = policy->on_tick(w->rq, running, n);
+  if (preempt && policy->throttle != NULL) until = policy->throttle(w->rq, running);
+  if (!preempt) arm_next_tick(next_decision(w, running));
+  if (until > 0) policy->on_block(w->rq, running, TRACE_TIMER);
+  worker_unlock(w);
+
+  if (until > 0) {
+    //Not to be queued before tick until: it waits on the timer wheel, as in mythread_sleep()
+    running->state = WAITING;
+    running->timer.expires = until;
+    running->wait_queue = NULL;
+    running->wait_state = 2;
+    w->timed = running;
+    w->wait_reason = TRACE_TIMER;
+    trace_event(TRACE_WAIT, TRACE_TIMER, running->tid, running->priority, -1, w->id);
+    w->old_running = running;
+
+    w->running = scheduler();
+    w->running->state = RUNNING;
+    activator(w->running);
+  } else if (preempt) {
     running->state = INIT;
     running->ticks = QUANTUM_TICKS;
-    disable_interrupt();
-    disable_disk_interrupt();
 
-    //We store the thread in our queue
-    enqueue(low_ready_list,running);
-    old_running = running;
+    //The scheduler queues it before it picks the next one, another worker can only run
+    //it once its context is saved (see finish_switch)
+    w->requeue = running;
+    w->old_running = running;
 
     //Call for the next thread to come
-    running = scheduler();
-    running->state = RUNNING;
-
-    enable_disk_interrupt();
-    enable_interrupt();
+    w->running = scheduler();
+    w->running->state = RUNNING;
 
     //Swap context
-    activator(running);
+    activator(w->running);
   }
 }
 
 /* Activator */
 void activator(TCB* next)
 {
+  TCB *old_running = this_worker()->old_running;
+
+  if (old_running != next) account_switch(this_worker(), old_running, next);
+
   switch (old_running->state)
   {
   case INIT:
     /* If both threads have the same priority normal message will be displayed*/
     if(old_running->priority == next->priority){
-      printf("*** SWAPCONTEXT FROM %d TO %d\n", old_running->tid, next->tid);
+      trace_event(TRACE_SWITCH, TRACE_SLICE, old_running->tid, old_running->priority, next->tid, this_worker()->id);
     }
     /* The only remaining case is that old = LOW & next = HIGH
     Because the case of old = HIGH & next = LOW only will possible when the HIGH-prio thread
@@ -386,25 +1564,36 @@ void activator(TCB* next)
         H                   H           SWAPCONTEXT
     */
     else {
-      printf("*** THREAD %d PREEMPTED: SET CONTEXT OF %d\n",old_running->tid, next->tid);
+      trace_event(TRACE_SWITCH, TRACE_PREEMPT, old_running->tid, old_running->priority, next->tid, this_worker()->id);
     }
 
-    //swapcontext returns -1 on error
-    if(swapcontext (&(old_running->run_env), &(next->run_env))) perror("Not possible to swap context");
+    //mctx_switch returns -1 on error
+    if(mctx_switch(&(old_running->run_env), &(next->run_env))) perror("Not possible to swap context");
+    finish_switch();
+    break;
+
+  case WAITING:
+    trace_event(TRACE_SWITCH, this_worker()->wait_reason, old_running->tid, old_running->priority, next->tid, this_worker()->id);
+    if(mctx_switch(&(old_running->run_env), &(next->run_env))) perror("Not possible to swap context");
+    finish_switch();
     break;
 
   case FREE:
-    printf("*** THREAD %d FINISHED: SET CONTEXT OF %d\n", old_running->tid, next->tid);
-    //setcontext returns -1 on error
-    if(setcontext(&(next->run_env))) perror("Not possible to swap context");
-    printf("mythread_free: After setcontext, should never get here!!...\n");
+    trace_event(TRACE_SWITCH, TRACE_FINISH, old_running->tid, old_running->priority, next->tid, this_worker()->id);
+    //mctx_jump returns -1 on error
+    if(mctx_jump(&(next->run_env))) perror("Not possible to swap context");
+    printf("mythread_free: After mctx_jump, should never get here!!...\n");
     break;
 
   case IDLE:
-    printf("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
+    trace_event(TRACE_SWITCH, TRACE_IDLE, old_running->tid, old_running->priority, next->tid, this_worker()->id);
+    if(mctx_switch(&(old_running->run_env), &(next->run_env))) perror("Not possible to swap context");
+    finish_switch();
     break;
 
   default:
+    //Nothing else was ready: the same thread goes on
+    finish_switch();
     break;
   }
 }
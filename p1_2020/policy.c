@@ -0,0 +1,24 @@
+#include <string.h>
+
+#include "policy.h"
+
+static struct sched_policy* policies[] = {
+  &policy_rr,
+  &policy_rrs,
+  &policy_rrsd,
+  &policy_cfs,
+  &policy_mlfq,
+  &policy_edf,
+  &policy_prio,
+  NULL
+};
+
+
+struct sched_policy* policy_find(const char* name)
+{
+  int i;
+
+  for (i = 0; policies[i] != NULL; i++)
+    if (strcmp(policies[i]->name, name) == 0) return policies[i];
+  return NULL;
+}
@@ -0,0 +1,71 @@
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include "mythread.h"
+
+/* Scheduling policy interface.
+   The core (mythreadlib.c) keeps the threads, contexts, workers and interrupts, and
+   asks the policy which thread runs next. Every worker has its own run queue, created
+   by init() and only touched with the worker locked and the interrupts disabled.
+   The policy is chosen once, before the library is initialized (mythread_set_policy) */
+
+struct sched_policy
+{
+  const char* name;
+  /* Read disk blocks the caller until a disk interrupt (the RRSD behaviour) */
+  int blocking_io;
+  /* Highest user priority: HIGH_PRIORITY, or up to MAX_PRIORITY */
+  int max_priority;
+  /* What the ready threads are sorted by, for the reports (see mythread_policy_order) */
+  const char* order;
+  /* Policies with an SJF class: the remaining_ticks a thread gets when it raises itself to
+     HIGH_PRIORITY (see mythread_setpriority). 0 if there is none */
+  int sjf_budget;
+
+  /* New empty run queue */
+  void* (*init)();
+  /* Room for capacity threads, so the interrupt handlers never allocate */
+  void (*reserve)(void* rq, int capacity);
+  /* t is ready: created or preempted */
+  void (*enqueue)(void* rq, TCB* t);
+  /* Removes and returns the next thread to run, NULL if the queue is empty */
+  TCB* (*pick_next)(void* rq);
+  /* Clock tick while t runs, after its counters are updated. In tickless mode one tick
+     can stand for several: ticks is how many. Returns 1 to preempt it */
+  int (*on_tick)(void* rq, TCB* t, int ticks);
+  /* t leaves the CPU to wait: reason is TRACE_IO (the disk), TRACE_TIMER (a sleep, or its
+     throttling) or TRACE_SYNC (see trace.h) */
+  void (*on_block)(void* rq, TCB* t, int reason);
+  /* t is ready again after its wait */
+  void (*on_wake)(void* rq, TCB* t);
+  /* Ticks until the policy may preempt t, 0 if never (only the end of t matters).
+     Used by the tickless mode */
+  int (*next_tick)(void* rq, TCB* t);
+  /* Optional: prints the state and the statistics of the run queue */
+  void (*report)(void* rq, FILE* out);
+  /* Optional, policies with deadline threads: admission control of a new one (0 if it
+     fits, -1 otherwise), and release of its share when it ends */
+  int (*admit)(int runtime, int deadline, int period);
+  void (*leave)(struct rt_params* rt);
+  /* Optional: called when on_tick() preempts t. Returns the tick of the timer wheel t has
+     to wait for before it is queued again (a deadline thread out of budget waits for its
+     next period), 0 to queue it at once */
+  long (*throttle)(void* rq, TCB* t);
+};
+
+/* Budget of the threads that enter the SJF class with mythread_setpriority() */
+#define SJF_BUDGET_TICKS 195
+
+/* Registered policies */
+extern struct sched_policy policy_rr;
+extern struct sched_policy policy_rrs;
+extern struct sched_policy policy_rrsd;
+extern struct sched_policy policy_cfs;
+extern struct sched_policy policy_mlfq;
+extern struct sched_policy policy_edf;
+extern struct sched_policy policy_prio;
+
+/* Returns the policy with the given name or NULL */
+struct sched_policy* policy_find(const char* name);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "heap.h"
+#include "tcb_store.h"
+
+/* Completely fair scheduling for low priority, SJF for high priority.
+   High priority threads run first, as in rrs. The low priority threads are sorted by their
+   virtual run time: the run time scaled by the weight of their nice value, so a thread
+   with a lower nice value gets a larger share of the CPU. The one that ran the least
+   runs next, for a slice of CFS_LATENCY_TICKS split among the ready threads by weight.
+   Reading the disk blocks, as in rrsd: a thread that waits gets ahead of the CPU bound
+   ones when it wakes up (up to CFS_SLEEPER_CREDIT), which keeps I/O bound threads responsive */
+
+/* Every ready low priority thread runs once in this period */
+#define CFS_LATENCY_TICKS QUANTUM_TICKS
+/* Shortest slice, however many threads are ready */
+#define CFS_MIN_GRANULARITY 4
+/* A running thread is preempted before the end of its slice if it is ahead of the next
+   one by more than this. Ticks of virtual run time, as vruntime: one per tick at nice 0 */
+#define CFS_WAKEUP_GRANULARITY 2
+/* A thread that waited for the disk keeps at most this much advantage (ticks of virtual run time) */
+#define CFS_SLEEPER_CREDIT (CFS_LATENCY_TICKS / 2)
+
+#define NICE_0_LOAD 1024
+
+/* Weight of each nice value, MIN_NICE to MAX_NICE: every level is about 10% of CPU time */
+static const int nice_to_weight[MAX_NICE - MIN_NICE + 1] = {
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */  9548,  7620,  6100,  4904,  3906,
+  /*  -5 */  3121,  2501,  1991,  1586,  1277,
+  /*   0 */  1024,   820,   655,   526,   423,
+  /*   5 */   335,   272,   215,   172,   137,
+  /*  10 */   110,    87,    70,    56,    45,
+  /*  15 */    36,    29,    23,    18,    15,
+};
+
+struct cfs_queue
+{
+  /* High priority, a heap sorted by the remaining execution time (SJF) */
+  struct tcb_heap *high;
+  /* Low priority, a heap sorted by the virtual run time */
+  struct tcb_heap *fair;
+  /* Sum of the weights of the threads in fair */
+  long load;
+  /* Never goes back: the virtual run time new and woken threads start from */
+  int min_vruntime;
+};
+
+
+static int weight(TCB *t)
+{
+  return nice_to_weight[t->nice - MIN_NICE];
+}
+
+/* Ticks t runs before the next fair thread, its share of the latency period */
+static int slice(struct cfs_queue *q, TCB *t)
+{
+  int s = (long) CFS_LATENCY_TICKS * weight(t) / (q->load + weight(t));
+  return s < CFS_MIN_GRANULARITY ? CFS_MIN_GRANULARITY : s;
+}
+
+static void update_min_vruntime(struct cfs_queue *q, TCB *running)
+{
+  TCB *first = tcb_heap_peek(q->fair);
+  int v = running->vruntime;
+
+  if (first != NULL && first->vruntime < v) v = first->vruntime;
+  if (v > q->min_vruntime) q->min_vruntime = v;
+}
+
+
+static void* cfs_init()
+{
+  struct cfs_queue *q = malloc(sizeof(struct cfs_queue));
+
+  if (q != NULL)
+  {
+    q->high = tcb_heap_new(TCB_SEGMENT_SIZE);
+    q->fair = tcb_heap_new(TCB_SEGMENT_SIZE);
+    q->load = 0;
+    q->min_vruntime = 0;
+  }
+  if (q == NULL || q->high == NULL || q->fair == NULL)
+  {
+    printf("*** ERROR: failed to allocate the ready queues\n");
+    exit(-1);
+  }
+  return q;
+}
+
+static void cfs_reserve(void *rq, int capacity)
+{
+  struct cfs_queue *q = rq;
+
+  tcb_heap_reserve(q->high, capacity);
+  tcb_heap_reserve(q->fair, capacity);
+}
+
+static void cfs_enqueue(void *rq, TCB *t)
+{
+  struct cfs_queue *q = rq;
+
+  if (t->priority == HIGH_PRIORITY) {
+    tcb_heap_push(q->high, t, t->remaining_ticks);
+    return;
+  }
+  //New threads, woken ones and the ones stolen from another worker do not get
+  //more than CFS_SLEEPER_CREDIT ahead of the threads already here
+  if (t->vruntime < q->min_vruntime - CFS_SLEEPER_CREDIT) t->vruntime = q->min_vruntime - CFS_SLEEPER_CREDIT;
+  q->load += weight(t);
+  tcb_heap_push(q->fair, t, t->vruntime);
+}
+
+static TCB* cfs_pick_next(void *rq)
+{
+  struct cfs_queue *q = rq;
+  TCB *t;
+
+  //The high-prio queue goes first
+  t = tcb_heap_pop(q->high);
+  if (t != NULL) return t;
+
+  t = tcb_heap_pop(q->fair);
+  if (t == NULL) return NULL;
+  q->load -= weight(t);
+  update_min_vruntime(q, t);
+  t->ticks = slice(q, t);
+  return t;
+}
+
+static int cfs_on_tick(void *rq, TCB *t, int ticks)
+{
+  struct cfs_queue *q = rq;
+  TCB *first;
+
+  if (t->priority == HIGH_PRIORITY) {
+    //SJF: preempted by a high priority thread that needs less time (LONG_MAX if none)
+    return t->remaining_ticks > tcb_heap_peek_key(q->high);
+  }
+  //The remainder of the division is kept, so heavy threads still advance
+  t->vruntime_rem += ticks * NICE_0_LOAD;
+  t->vruntime += t->vruntime_rem / weight(t);
+  t->vruntime_rem %= weight(t);
+  update_min_vruntime(q, t);
+
+  //A low priority thread always leaves the CPU to a high priority one
+  if (!tcb_heap_empty(q->high)) return 1;
+
+  first = tcb_heap_peek(q->fair);
+  if (first == NULL) {
+    //Nobody else is ready, a new slice starts
+    if (t->ticks <= 0) t->ticks = slice(q, t);
+    return 0;
+  }
+  //End of its slice, or too far ahead of the thread that ran the least
+  return t->ticks <= 0 || t->vruntime - first->vruntime > CFS_WAKEUP_GRANULARITY;
+}
+
+static void cfs_on_block(void *rq, TCB *t, int reason)
+{
+}
+
+static void cfs_on_wake(void *rq, TCB *t)
+{
+  cfs_enqueue(rq, t);
+}
+
+static int cfs_next_tick(void *rq, TCB *t)
+{
+  struct cfs_queue *q = rq;
+  TCB *first;
+  int n;
+
+  if (t->priority == HIGH_PRIORITY) return 0;
+  if (!tcb_heap_empty(q->high)) return 1;
+  first = tcb_heap_peek(q->fair);
+  if (first == NULL) return 0;
+  n = t->ticks > 0 ? t->ticks : 1;
+  //A thread woken behind it may preempt it before the end of the slice
+  if (first->vruntime + CFS_WAKEUP_GRANULARITY < t->vruntime + n * NICE_0_LOAD / weight(t))
+  {
+    n = (first->vruntime + CFS_WAKEUP_GRANULARITY - t->vruntime) * weight(t) / NICE_0_LOAD + 1;
+    if (n < 1) n = 1;
+  }
+  return n;
+}
+
+
+struct sched_policy policy_cfs = {
+  .name = "cfs",
+  .blocking_io = 1,
+  .max_priority = HIGH_PRIORITY,
+  .order = "high: remaining budget (SJF), low: vruntime",
+  .sjf_budget = SJF_BUDGET_TICKS,
+  .init = cfs_init,
+  .reserve = cfs_reserve,
+  .enqueue = cfs_enqueue,
+  .pick_next = cfs_pick_next,
+  .on_tick = cfs_on_tick,
+  .on_block = cfs_on_block,
+  .on_wake = cfs_on_wake,
+  .next_tick = cfs_next_tick,
+};
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "queue.h"
+#include "heap.h"
+#include "tcb_store.h"
+
+/* Earliest deadline first for the deadline threads (mythread_create_deadline), before
+   SJF for high priority and RR for low priority as in rrs.
+   The deadline thread with the earliest absolute deadline runs first. A periodic thread
+   that runs out of budget is throttled: it waits on the timer wheel until its next
+   release (see throttle in policy.h), so it never takes more than runtime ticks per
+   period and the other threads get the rest of the CPU. A thread that wakes up after
+   the end of its period starts a new job then.
+   Admission control keeps the total density (runtime / min(deadline, period)) of the
+   deadline threads within EDF_CAPACITY of one CPU, the bound under which EDF meets every
+   deadline. Deadlines are in ticks of the timer wheel, the same in every worker and
+   going on while they are idle. Reading the disk blocks, as in rrsd */
+
+/* Parts per million of one CPU */
+#define EDF_CAPACITY 1000000L
+
+struct edf_queue
+{
+  /* Deadline threads, a heap sorted by the absolute deadline */
+  struct tcb_heap *rt;
+  /* High priority, a heap sorted by the remaining execution time (SJF) */
+  struct tcb_heap *high;
+  /* Low priority, arrival order (FIFO) */
+  struct tcb_queue *low;
+  /* Statistics of every job of this worker */
+  long jobs;
+  long misses;
+  long max_lateness;
+};
+
+/* Density of the admitted deadline threads, in parts per million of one CPU */
+static long utilization = 0;
+
+
+static long density(int runtime, int deadline, int period)
+{
+  int window = period > 0 && period < deadline ? period : deadline;
+  return (runtime * EDF_CAPACITY + window - 1) / window;
+}
+
+/* Current tick of the timer wheel */
+static long edf_now()
+{
+  return clock_now() / tick_length();
+}
+
+/* Starts a job of t released at tick release */
+static void release_job(struct edf_queue *q, TCB *t, long release)
+{
+  t->rt.release = release;
+  t->rt.abs_deadline = release + t->rt.deadline;
+  t->rt.budget = t->rt.runtime;
+  t->rt.missed = 0;
+  t->rt.stats.jobs++;
+  q->jobs++;
+}
+
+/* Counts the current job of t as a miss once, if it is past its deadline */
+static void check_deadline(struct edf_queue *q, TCB *t)
+{
+  long lateness = edf_now() - t->rt.abs_deadline;
+
+  if (lateness <= 0) return;
+  if (lateness > t->rt.stats.max_lateness) t->rt.stats.max_lateness = lateness;
+  if (lateness > q->max_lateness) q->max_lateness = lateness;
+  if (t->rt.missed) return;
+  t->rt.missed = 1;
+  t->rt.stats.misses++;
+  q->misses++;
+}
+
+
+static void* edf_init()
+{
+  struct edf_queue *q = calloc(1, sizeof(struct edf_queue));
+
+  if (q != NULL)
+  {
+    q->rt = tcb_heap_new(TCB_SEGMENT_SIZE);
+    q->high = tcb_heap_new(TCB_SEGMENT_SIZE);
+    q->low = tcb_queue_new();
+  }
+  if (q == NULL || q->rt == NULL || q->high == NULL || q->low == NULL)
+  {
+    printf("*** ERROR: failed to allocate the ready queues\n");
+    exit(-1);
+  }
+  return q;
+}
+
+static void edf_reserve(void *rq, int capacity)
+{
+  struct edf_queue *q = rq;
+
+  tcb_heap_reserve(q->rt, capacity);
+  tcb_heap_reserve(q->high, capacity);
+}
+
+static void edf_enqueue(void *rq, TCB *t)
+{
+  struct edf_queue *q = rq;
+
+  long now, next;
+
+  if (t->priority == REALTIME) {
+    now = edf_now();
+    next = t->rt.release + t->rt.period;
+    //The first job is released when the thread is first queued. A periodic one is due
+    //again when it comes back from its throttling, or from a wait past its period. If it
+    //is more than a period late it starts over from now, it does not catch up
+    if (t->rt.abs_deadline < 0) release_job(q, t, now);
+    else if (t->rt.period > 0 && now >= next) release_job(q, t, now - next < t->rt.period ? next : now);
+    tcb_heap_push(q->rt, t, t->rt.abs_deadline);
+  }
+  else if (t->priority == HIGH_PRIORITY) tcb_heap_push(q->high, t, t->remaining_ticks);
+  else tcb_enqueue(q->low, t);
+}
+
+static TCB* edf_pick_next(void *rq)
+{
+  struct edf_queue *q = rq;
+  TCB *t;
+
+  t = tcb_heap_pop(q->rt);
+  if (t != NULL) {
+    //It may have waited past its deadline
+    check_deadline(q, t);
+    return t;
+  }
+  t = tcb_heap_pop(q->high);
+  if (t == NULL) t = tcb_dequeue(q->low);
+  return t;
+}
+
+static int edf_on_tick(void *rq, TCB *t, int ticks)
+{
+  struct edf_queue *q = rq;
+  TCB *first = tcb_heap_peek(q->rt);
+  long next;
+
+  if (t->priority == REALTIME) {
+    t->rt.budget -= ticks;
+    check_deadline(q, t);
+    if (t->rt.budget <= 0 && t->rt.period > 0) {
+      next = t->rt.release + t->rt.period;
+      //Out of budget before its next release: throttled (see edf_throttle)
+      if (edf_now() < next) return 1;
+      //Its period is over already, the next job starts at once
+      release_job(q, t, edf_now() - next < t->rt.period ? next : edf_now());
+    }
+    //A deadline thread with an earlier deadline is ready
+    return tcb_heap_peek_key(q->rt) < t->rt.abs_deadline;
+  }
+  //Deadline threads go before the others
+  if (first != NULL) return 1;
+
+  if (!tcb_heap_empty(q->high)) {
+    if (t->priority == LOW_PRIORITY) return 1;
+    return t->remaining_ticks > tcb_heap_peek_key(q->high);
+  }
+  return t->priority == LOW_PRIORITY && t->ticks <= 0;
+}
+
+static void edf_on_block(void *rq, TCB *t, int reason)
+{
+}
+
+static void edf_on_wake(void *rq, TCB *t)
+{
+  edf_enqueue(rq, t);
+}
+
+static int edf_next_tick(void *rq, TCB *t)
+{
+  struct edf_queue *q = rq;
+  long n;
+
+  if (t->priority == REALTIME) {
+    //End of the budget, or the deadline of the current job
+    n = t->rt.budget > 0 ? t->rt.budget : 1;
+    if (!t->rt.missed && t->rt.abs_deadline + 1 - edf_now() < n) n = t->rt.abs_deadline + 1 - edf_now();
+    return n > 0 ? n : 1;
+  }
+  if (!tcb_heap_empty(q->rt)) return 1;
+  if (!tcb_heap_empty(q->high)) return t->priority == LOW_PRIORITY ? 1 : 0;
+  if (t->priority == LOW_PRIORITY && !tcb_queue_empty(q->low)) return t->ticks > 0 ? t->ticks : 1;
+  return 0;
+}
+
+/* A periodic deadline thread out of budget waits until its next release */
+static long edf_throttle(void *rq, TCB *t)
+{
+  if (t->priority != REALTIME || t->rt.period == 0 || t->rt.budget > 0) return 0;
+  return t->rt.release + t->rt.period;
+}
+
+static void edf_report(void *rq, FILE *out)
+{
+  struct edf_queue *q = rq;
+
+  fprintf(out, "*** EDF: %ld jobs, %ld deadline misses, max lateness %ld ticks, utilization %.1f%%\n",
+          q->jobs, q->misses, q->max_lateness, __atomic_load_n(&utilization, __ATOMIC_RELAXED) / 1e4);
+}
+
+static int edf_admit(int runtime, int deadline, int period)
+{
+  long d = density(runtime, deadline, period);
+  long u = __atomic_load_n(&utilization, __ATOMIC_RELAXED);
+
+  do {
+    if (u + d > EDF_CAPACITY) return -1;
+  } while (!__atomic_compare_exchange_n(&utilization, &u, u + d, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+  return 0;
+}
+
+static void edf_leave(struct rt_params *rt)
+{
+  __atomic_sub_fetch(&utilization, density(rt->runtime, rt->deadline, rt->period), __ATOMIC_SEQ_CST);
+}
+
+
+struct sched_policy policy_edf = {
+  .name = "edf",
+  .blocking_io = 1,
+  .max_priority = HIGH_PRIORITY,
+  .order = "deadline: absolute deadline, high: remaining budget (SJF), low: arrival (FIFO)",
+  .sjf_budget = SJF_BUDGET_TICKS,
+  .init = edf_init,
+  .reserve = edf_reserve,
+  .enqueue = edf_enqueue,
+  .pick_next = edf_pick_next,
+  .on_tick = edf_on_tick,
+  .on_block = edf_on_block,
+  .on_wake = edf_on_wake,
+  .next_tick = edf_next_tick,
+  .report = edf_report,
+  .admit = edf_admit,
+  .leave = edf_leave,
+  .throttle = edf_throttle,
+};
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "queue.h"
+#include "trace.h"
+
+/* Multi-level feedback queue.
+   MLFQ_LEVELS round robin queues, level 0 first. A thread starts at level 0 (high priority)
+   or 1 (low priority), goes one level down when it uses its whole slice (CPU bound) and
+   one level up when it blocks reading the disk (I/O bound). Lower levels have longer slices.
+   A thread that waited more than STARVATION ticks at a lower level is boosted to level 0,
+   so short high priority jobs can not starve the rest.
+   Times are in ticks of the worker clock, which only advances while a thread runs */
+
+#define MLFQ_LEVELS 4
+/* Slice of each level: QUANTUM_TICKS / 4 at level 0, doubled at every level */
+#define MLFQ_SLICE(level) ((QUANTUM_TICKS / 4) << (level))
+
+struct mlfq_level
+{
+  struct tcb_queue *ready;
+  int length;
+  /* Statistics, for tuning */
+  int max_length;
+  long dispatched;
+  long wait_total;
+  long wait_max;
+};
+
+struct mlfq_queue
+{
+  struct mlfq_level levels[MLFQ_LEVELS];
+  /* Ticks run in this worker */
+  long now;
+  long demotions;
+  long promotions;
+  long boosts;
+};
+
+
+static void push(struct mlfq_queue *q, TCB *t)
+{
+  struct mlfq_level *l = &q->levels[t->level];
+
+  tcb_enqueue(l->ready, t);
+  if (++l->length > l->max_length) l->max_length = l->length;
+}
+
+/* Boosts to level 0 the threads waiting for longer than STARVATION. Every level is FIFO,
+   so only the first threads of each level have to be looked at */
+static void age(struct mlfq_queue *q)
+{
+  struct mlfq_level *l;
+  TCB *t;
+  int i;
+
+  for (i = 1; i < MLFQ_LEVELS; i++) {
+    l = &q->levels[i];
+    while (l->ready->head != NULL && q->now - l->ready->head->ready_since > STARVATION) {
+      t = tcb_dequeue(l->ready);
+      l->length--;
+      t->level = 0;
+      push(q, t);
+      q->boosts++;
+    }
+  }
+}
+
+/* Highest level with ready threads, MLFQ_LEVELS if none */
+static int top_level(struct mlfq_queue *q)
+{
+  int i;
+
+  for (i = 0; i < MLFQ_LEVELS && q->levels[i].length == 0; i++);
+  return i;
+}
+
+
+static void* mlfq_init()
+{
+  struct mlfq_queue *q = calloc(1, sizeof(struct mlfq_queue));
+  int i;
+
+  for (i = 0; q != NULL && i < MLFQ_LEVELS; i++) {
+    q->levels[i].ready = tcb_queue_new();
+    if (q->levels[i].ready == NULL) q = NULL;
+  }
+  if (q == NULL)
+  {
+    printf("*** ERROR: failed to allocate the ready queues\n");
+    exit(-1);
+  }
+  return q;
+}
+
+static void mlfq_reserve(void *rq, int capacity)
+{
+  //The queues are linked through the TCBs, they never allocate
+}
+
+static void mlfq_enqueue(void *rq, TCB *t)
+{
+  struct mlfq_queue *q = rq;
+
+  //New threads: the priority sets the first level
+  if (t->level < 0) t->level = t->priority == HIGH_PRIORITY ? 0 : 1;
+  t->ready_since = q->now;
+  push(q, t);
+}
+
+static TCB* mlfq_pick_next(void *rq)
+{
+  struct mlfq_queue *q = rq;
+  struct mlfq_level *l;
+  long wait;
+  TCB *t;
+  int i;
+
+  age(q);
+  i = top_level(q);
+  if (i == MLFQ_LEVELS) return NULL;
+
+  l = &q->levels[i];
+  t = tcb_dequeue(l->ready);
+  l->length--;
+  wait = q->now - t->ready_since;
+  l->dispatched++;
+  l->wait_total += wait;
+  if (wait > l->wait_max) l->wait_max = wait;
+  t->ticks = MLFQ_SLICE(t->level);
+  return t;
+}
+
+static int mlfq_on_tick(void *rq, TCB *t, int ticks)
+{
+  struct mlfq_queue *q = rq;
+  int top;
+
+  q->now += ticks;
+  age(q);
+  top = top_level(q);
+
+  if (t->ticks <= 0) {
+    //Used its whole slice: CPU bound
+    if (t->level < MLFQ_LEVELS - 1) {
+      t->level++;
+      q->demotions++;
+    }
+    if (top < MLFQ_LEVELS) return 1;
+    //Nobody else is ready, a new slice starts
+    t->ticks = MLFQ_SLICE(t->level);
+    return 0;
+  }
+  //A thread at a higher level is ready
+  return top < t->level;
+}
+
+static void mlfq_on_block(void *rq, TCB *t, int reason)
+{
+  struct mlfq_queue *q = rq;
+
+  //Left the CPU before the end of its slice to read the disk: I/O bound. A sleep, a lock
+  //or its throttling says nothing of how it uses the CPU
+  if (reason == TRACE_IO && t->level > 0) {
+    t->level--;
+    q->promotions++;
+  }
+}
+
+static void mlfq_on_wake(void *rq, TCB *t)
+{
+  mlfq_enqueue(rq, t);
+}
+
+static int mlfq_next_tick(void *rq, TCB *t)
+{
+  struct mlfq_queue *q = rq;
+  TCB *first;
+  int i, n, top = top_level(q);
+
+  if (top == MLFQ_LEVELS) return 0;
+  if (top < t->level) return 1;
+  n = t->ticks > 0 ? t->ticks : 1;
+  //The first thread of every lower level may have to be boosted before that
+  for (i = 1; i < MLFQ_LEVELS; i++) {
+    first = q->levels[i].ready->head;
+    if (first != NULL && first->ready_since + STARVATION + 1 - q->now < n)
+      n = first->ready_since + STARVATION + 1 - q->now;
+  }
+  return n > 0 ? n : 1;
+}
+
+static void mlfq_report(void *rq, FILE *out)
+{
+  struct mlfq_queue *q = rq;
+  struct mlfq_level *l;
+  int i;
+
+  for (i = 0; i < MLFQ_LEVELS; i++) {
+    l = &q->levels[i];
+    fprintf(out, "*** MLFQ level %d (slice %d): %d ready (max %d), %ld dispatched, wait avg %.1f max %ld ticks\n",
+            i, MLFQ_SLICE(i), l->length, l->max_length, l->dispatched,
+            l->dispatched > 0 ? (double) l->wait_total / l->dispatched : 0.0, l->wait_max);
+  }
+  fprintf(out, "*** MLFQ: %ld demotions, %ld promotions, %ld boosts\n", q->demotions, q->promotions, q->boosts);
+}
+
+
+struct sched_policy policy_mlfq = {
+  .name = "mlfq",
+  .blocking_io = 1,
+  .max_priority = HIGH_PRIORITY,
+  .order = "level (down with CPU use, up with I/O), then arrival",
+  .init = mlfq_init,
+  .reserve = mlfq_reserve,
+  .enqueue = mlfq_enqueue,
+  .pick_next = mlfq_pick_next,
+  .on_tick = mlfq_on_tick,
+  .on_block = mlfq_on_block,
+  .on_wake = mlfq_on_wake,
+  .next_tick = mlfq_next_tick,
+  .report = mlfq_report,
+};
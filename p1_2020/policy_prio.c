@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "policy.h"
+#include "queue.h"
+
+/* Fixed priorities: PRIORITY_LEVELS round robin queues, from LOW_PRIORITY to MAX_PRIORITY.
+   The highest priority ready thread always runs, the ones with the same priority share the
+   CPU in QUANTUM_TICKS slices. A bitmap of the non empty queues finds it with a single
+   count leading zeros, however many threads or levels there are */
+
+#if PRIORITY_LEVELS > 64
+#error "the prio policy keeps one bit per priority in a 64 bit word"
+#endif
+
+struct prio_queue
+{
+  /* Bit p is set when ready[p] is not empty */
+  uint64_t bitmap;
+  struct tcb_queue *ready[PRIORITY_LEVELS];
+};
+
+
+/* Highest priority with ready threads, -1 if none */
+static int top_priority(struct prio_queue *q)
+{
+  return q->bitmap == 0 ? -1 : 63 - __builtin_clzll(q->bitmap);
+}
+
+
+static void* prio_init()
+{
+  struct prio_queue *q = calloc(1, sizeof(struct prio_queue));
+  int i;
+
+  for (i = 0; q != NULL && i < PRIORITY_LEVELS; i++) {
+    q->ready[i] = tcb_queue_new();
+    if (q->ready[i] == NULL) q = NULL;
+  }
+  if (q == NULL)
+  {
+    printf("*** ERROR: failed to allocate the ready queues\n");
+    exit(-1);
+  }
+  return q;
+}
+
+static void prio_reserve(void *rq, int capacity)
+{
+  //The queues are linked through the TCBs, they never allocate
+}
+
+static void prio_enqueue(void *rq, TCB *t)
+{
+  struct prio_queue *q = rq;
+
+  tcb_enqueue(q->ready[t->priority], t);
+  q->bitmap |= (uint64_t) 1 << t->priority;
+}
+
+static TCB* prio_pick_next(void *rq)
+{
+  struct prio_queue *q = rq;
+  int p = top_priority(q);
+  TCB *t;
+
+  if (p < 0) return NULL;
+  t = tcb_dequeue(q->ready[p]);
+  if (tcb_queue_empty(q->ready[p])) q->bitmap &= ~((uint64_t) 1 << p);
+  return t;
+}
+
+static int prio_on_tick(void *rq, TCB *t, int ticks)
+{
+  struct prio_queue *q = rq;
+  int p = top_priority(q);
+
+  //A higher priority thread is ready
+  if (p > t->priority) return 1;
+  if (t->ticks > 0) return 0;
+  //End of the slice: round robin with the threads of the same priority
+  if (p == t->priority) return 1;
+  t->ticks = QUANTUM_TICKS;
+  return 0;
+}
+
+static void prio_on_block(void *rq, TCB *t, int reason)
+{
+}
+
+static void prio_on_wake(void *rq, TCB *t)
+{
+  t->ticks = QUANTUM_TICKS;
+  prio_enqueue(rq, t);
+}
+
+static int prio_next_tick(void *rq, TCB *t)
+{
+  struct prio_queue *q = rq;
+  int p = top_priority(q);
+
+  if (p > t->priority) return 1;
+  if (p == t->priority) return t->ticks > 0 ? t->ticks : 1;
+  return 0;
+}
+
+
+struct sched_policy policy_prio = {
+  .name = "prio",
+  .blocking_io = 1,
+  .max_priority = MAX_PRIORITY,
+  .order = "priority, then arrival (FIFO)",
+  .init = prio_init,
+  .reserve = prio_reserve,
+  .enqueue = prio_enqueue,
+  .pick_next = prio_pick_next,
+  .on_tick = prio_on_tick,
+  .on_block = prio_on_block,
+  .on_wake = prio_on_wake,
+  .next_tick = prio_next_tick,
+};
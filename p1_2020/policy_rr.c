@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "queue.h"
+
+/* Round robin: one FIFO queue for every priority. A thread runs for QUANTUM_TICKS
+   and goes back to the end of the queue, unless nothing else is ready */
+
+static void* rr_init()
+{
+  struct tcb_queue *q = tcb_queue_new();
+
+  if (q == NULL)
+  {
+    printf("*** ERROR: failed to allocate the ready queue\n");
+    exit(-1);
+  }
+  return q;
+}
+
+static void rr_reserve(void *rq, int capacity)
+{
+  //The queue is linked through the TCBs, it never allocates
+}
+
+static void rr_enqueue(void *rq, TCB *t)
+{
+  tcb_enqueue(rq, t);
+}
+
+static TCB* rr_pick_next(void *rq)
+{
+  return tcb_dequeue(rq);
+}
+
+static int rr_on_tick(void *rq, TCB *t, int ticks)
+{
+  if (t->ticks > 0) return 0;
+  //If slice ends
+  if (!tcb_queue_empty(rq)) return 1;
+  //Nobody else is ready, a new slice starts
+  t->ticks = QUANTUM_TICKS;
+  return 0;
+}
+
+static void rr_on_block(void *rq, TCB *t, int reason)
+{
+}
+
+static void rr_on_wake(void *rq, TCB *t)
+{
+  t->ticks = QUANTUM_TICKS;
+  tcb_enqueue(rq, t);
+}
+
+static int rr_next_tick(void *rq, TCB *t)
+{
+  if (tcb_queue_empty(rq)) return 0;
+  return t->ticks > 0 ? t->ticks : 1;
+}
+
+
+struct sched_policy policy_rr = {
+  .name = "rr",
+  .blocking_io = 0,
+  .max_priority = HIGH_PRIORITY,
+  .order = "arrival (FIFO), every priority alike",
+  .init = rr_init,
+  .reserve = rr_reserve,
+  .enqueue = rr_enqueue,
+  .pick_next = rr_pick_next,
+  .on_tick = rr_on_tick,
+  .on_block = rr_on_block,
+  .on_wake = rr_on_wake,
+  .next_tick = rr_next_tick,
+};
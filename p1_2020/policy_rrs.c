@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "policy.h"
+#include "queue.h"
+#include "heap.h"
+#include "tcb_store.h"
+
+/* SJF for high priority, RR for low priority.
+   A high priority thread always runs before a low priority one: the high priority
+   threads are sorted by their remaining execution time, and the running one is preempted
+   by a shorter one. The low priority threads share the CPU in QUANTUM_TICKS slices.
+   RRSD is the same policy, with read_disk blocking the caller (see blocking_io) */
+
+struct rrs_queue
+{
+  /* High priority, a heap sorted by the remaining execution time (SJF) */
+  struct tcb_heap *high;
+  /* Low priority, arrival order (FIFO) */
+  struct tcb_queue *low;
+};
+
+
+static void* rrs_init()
+{
+  struct rrs_queue *q = malloc(sizeof(struct rrs_queue));
+
+  if (q != NULL)
+  {
+    q->high = tcb_heap_new(TCB_SEGMENT_SIZE);
+    q->low = tcb_queue_new();
+  }
+  if (q == NULL || q->high == NULL || q->low == NULL)
+  {
+    printf("*** ERROR: failed to allocate the ready queues\n");
+    exit(-1);
+  }
+  return q;
+}
+
+static void rrs_reserve(void *rq, int capacity)
+{
+  struct rrs_queue *q = rq;
+  tcb_heap_reserve(q->high, capacity);
+}
+
+static void rrs_enqueue(void *rq, TCB *t)
+{
+  struct rrs_queue *q = rq;
+
+  if (t->priority == HIGH_PRIORITY) tcb_heap_push(q->high, t, t->remaining_ticks);
+  else tcb_enqueue(q->low, t);
+}
+
+static TCB* rrs_pick_next(void *rq)
+{
+  struct rrs_queue *q = rq;
+  TCB *t;
+
+  //The high-prio queue goes first, then the low-prio one
+  t = tcb_heap_pop(q->high);
+  if (t == NULL) t = tcb_dequeue(q->low);
+  return t;
+}
+
+static int rrs_on_tick(void *rq, TCB *t, int ticks)
+{
+  struct rrs_queue *q = rq;
+
+  if (!tcb_heap_empty(q->high)) {//high-prio queue not empty
+    //Save the context of the low priority thread and run the high priority one
+    if (t->priority == LOW_PRIORITY) return 1;
+    /*IF the current high-pri thread needs more time to execute than the first thread in the
+     high_ready_queue (the one with sortest execution time) then the running thread is enqueued and the ready one is set to run
+    */
+    return t->remaining_ticks > tcb_heap_peek_key(q->high);
+  }
+  //If high-prio queue is empty
+  //If a low priority thread is running AND its slice ends
+  return t->priority == LOW_PRIORITY && t->ticks <= 0;
+}
+
+static void rrs_on_block(void *rq, TCB *t, int reason)
+{
+}
+
+static void rrs_on_wake(void *rq, TCB *t)
+{
+  rrs_enqueue(rq, t);
+}
+
+static int rrs_next_tick(void *rq, TCB *t)
+{
+  struct rrs_queue *q = rq;
+
+  if (!tcb_heap_empty(q->high)) {
+    //A low priority thread is preempted at the next tick. A high priority one is
+    //only compared again with the queue when it changes (SJF on the remaining time)
+    return t->priority == LOW_PRIORITY ? 1 : 0;
+  }
+  if (t->priority == LOW_PRIORITY && !tcb_queue_empty(q->low)) {
+    //Round robin with the other low priority threads at the end of the slice
+    return t->ticks > 0 ? t->ticks : 1;
+  }
+  return 0;
+}
+
+
+struct sched_policy policy_rrs = {
+  .name = "rrs",
+  .blocking_io = 0,
+  .max_priority = HIGH_PRIORITY,
+  .order = "high: remaining budget (SJF), low: arrival (FIFO)",
+  .sjf_budget = SJF_BUDGET_TICKS,
+  .init = rrs_init,
+  .reserve = rrs_reserve,
+  .enqueue = rrs_enqueue,
+  .pick_next = rrs_pick_next,
+  .on_tick = rrs_on_tick,
+  .on_block = rrs_on_block,
+  .on_wake = rrs_on_wake,
+  .next_tick = rrs_next_tick,
+};
+
+struct sched_policy policy_rrsd = {
+  .name = "rrsd",
+  .blocking_io = 1,
+  .max_priority = HIGH_PRIORITY,
+  .order = "high: remaining budget (SJF), low: arrival (FIFO)",
+  .sjf_budget = SJF_BUDGET_TICKS,
+  .init = rrs_init,
+  .reserve = rrs_reserve,
+  .enqueue = rrs_enqueue,
+  .pick_next = rrs_pick_next,
+  .on_tick = rrs_on_tick,
+  .on_block = rrs_on_block,
+  .on_wake = rrs_on_wake,
+  .next_tick = rrs_next_tick,
+};
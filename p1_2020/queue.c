@@ -255,3 +255,89 @@ void queue_print_element(struct my_struct* p )
       printf("Can not print NULL struct \n");
 }
 
+
+
+/* Intrusive TCB queue. Same semantics as the queue above, but the TCB is the node */
+
+struct tcb_queue* tcb_enqueue(struct tcb_queue* s, TCB* tcb)
+{
+  if( NULL == s )
+    {
+      printf("Queue not initialized\n");
+      return s;
+    }
+  tcb->next = NULL;
+  if( NULL == s->head )
+    s->head = s->tail = tcb;
+  else
+    {
+      s->tail->next = tcb;
+      s->tail = tcb;
+    }
+  return s;
+}
+
+
+TCB* tcb_dequeue(struct tcb_queue* s)
+{
+  TCB* ret;
+
+  if( NULL == s || NULL == s->head )
+    return NULL;
+  ret = s->head;
+  s->head = ret->next;
+  if( NULL == s->head ) s->tail = NULL;
+  ret->next = NULL;
+  return ret;
+}
+
+
+TCB* tcb_queue_find_remove(struct tcb_queue* s, TCB* tcb)
+{
+  TCB* aux;
+
+  if( NULL == s || NULL == s->head )
+    return NULL;
+
+  if( s->head == tcb )
+    return tcb_dequeue(s);
+
+  for( aux = s->head; aux->next && aux->next != tcb; aux = aux->next );
+  if( NULL == aux->next )
+    return NULL;
+  aux->next = tcb->next;
+  if( s->tail == tcb ) s->tail = aux;
+  tcb->next = NULL;
+  return tcb;
+}
+
+
+int tcb_queue_empty(struct tcb_queue* s) { return (s->head == NULL); }
+
+
+struct tcb_queue* tcb_queue_new(void)
+{
+  struct tcb_queue* p = malloc(sizeof(struct tcb_queue));
+  if( NULL == p )
+    {
+      fprintf(stderr, "LINE: %d, malloc() failed\n", __LINE__);
+      return NULL;
+    }
+  p->head = p->tail = NULL;
+  return p;
+}
+
+
+void tcb_queue_print(struct tcb_queue* ps)
+{
+  TCB* p;
+  printf("Queue contents:\n");
+  if( ps )
+    {
+      if (tcb_queue_empty(ps))
+	printf("\t\tEmpty QUEUE\n");
+      else
+	for( p = ps->head; p; p = p->next )
+	  printf("\t\ttid=%d\n", p->tid);
+    }
+}
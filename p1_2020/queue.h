@@ -36,6 +36,28 @@ struct queue* queue_new(void);
 void queue_print(struct queue* );
 void queue_print_element(struct my_struct* );
 
+
+/* Intrusive queue of TCBs: the link is the next field of the TCB itself,
+   so enqueueing and dequeueing never allocate memory (safe inside the signal handlers) */
+struct tcb_queue
+{
+  TCB* head;
+  TCB* tail;
+};
+
+/* Enqueue a TCB at the tail */
+struct tcb_queue* tcb_enqueue(struct tcb_queue*, TCB* tcb);
+/* Dequeue the first TCB. Returns NULL if the queue is empty */
+TCB* tcb_dequeue(struct tcb_queue*);
+/* Return 1 if the queue is empty and 0 otherwise*/
+int tcb_queue_empty(struct tcb_queue* s);
+/* If it finds the TCB in the queue it removes it and returns it. Otherwise it returns NULL */
+TCB* tcb_queue_find_remove(struct tcb_queue* s, TCB* tcb);
+/* Create an empty queue */
+struct tcb_queue* tcb_queue_new(void);
+
+void tcb_queue_print(struct tcb_queue* );
+
 #endif
 
 
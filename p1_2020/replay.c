@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mythread.h"
+
+/* Workload trace replay, to compare the scheduling policies on the same arrivals.
+   Every line of the trace is a job: its arrival in us since the start, its priority, and
+   its phases in order, cN for a CPU burst of N us and rN for a read_disk() of N bytes:
+     # arrival_us priority phases...
+     0 0 c20000 r4096 c5000
+     1500 1 c800
+   A dispatcher thread spawns every job at its arrival, each one runs its phases with
+   mythread_burn() and read_disk(), on the replay program file. Its time budget is the
+   sum of its CPU bursts with a margin (see REPLAY_BUDGET_MARGIN): the SJF policies sort
+   their high priority threads by what is left of it. What every policy sorts the ready
+   threads by is printed below the table.
+   Every policy replays the trace in its own process, in a simulation (see
+   mythread_set_simulation) unless -r is given: then the run is deterministic and takes
+   much less than the trace. It prints one line per policy with the makespan, the
+   throughput, and the turnaround (arrival to end) and waiting (ready, and arrival to
+   spawn) times of the jobs. Arrivals are seen at the first tick after them.
+   Usage: replay [-r] trace [policy...] (default: rr rrs rrsd) */
+
+#define REPLAY_STACK (64 * 1024)
+#define REPLAY_TIMEOUT 600
+#define REPLAY_MAX_PHASES 64
+/* The budget of a job is its CPU bursts, plus 1/REPLAY_BUDGET_MARGIN of them and
+   REPLAY_BUDGET_SLACK ticks: it is ejected when the budget runs out, and every time it
+   runs again it can be charged a part of a tick more than it takes */
+#define REPLAY_BUDGET_MARGIN 8
+#define REPLAY_BUDGET_SLACK 2
+
+struct job
+{
+  long long arrival; /* ns since the start */
+  int priority;
+  int phases;
+  char kind[REPLAY_MAX_PHASES]; /* 'c' or 'r' */
+  long long amount[REPLAY_MAX_PHASES]; /* ns of CPU or bytes to read */
+  long long cpu; /* ns of all the CPU bursts */
+  /* Results */
+  int tid;
+  long long spawned; /* ns since the start */
+  int done; /* Ran all its phases, it was not ejected */
+  struct mythread_stats stats; /* At its end */
+};
+
+static struct job *jobs;
+static int njobs;
+static char *data_path;
+static off_t data_size;
+static int realtime = 0;
+static int result_fd;
+static int main_tid;
+
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(double *v, int n, double p)
+{
+  int i = (int)(p * (n - 1));
+  return n > 0 ? v[i] : 0.0;
+}
+
+static int compare_arrival(const void *a, const void *b)
+{
+  const struct job *x = a, *y = b;
+  return (x->arrival > y->arrival) - (x->arrival < y->arrival);
+}
+
+/* Reads the trace into jobs, sorted by arrival */
+static void load_trace(const char *path)
+{
+  char line[4096], *p, *end;
+  int capacity = 64, n;
+  long long arrival;
+  struct job *j;
+  FILE *f;
+
+  f = fopen(path, "r");
+  if (f == NULL)
+  {
+    perror("*** ERROR: open trace");
+    exit(-1);
+  }
+  jobs = malloc(capacity * sizeof(struct job));
+  for (n = 1; fgets(line, sizeof(line), f) != NULL; n++)
+  {
+    p = line + strspn(line, " \t");
+    if (*p == '#' || *p == '\n' || *p == '\0') continue;
+    if (njobs == capacity)
+    {
+      capacity *= 2;
+      jobs = realloc(jobs, capacity * sizeof(struct job));
+    }
+    if (jobs == NULL)
+    {
+      printf("*** ERROR: failed to allocate the jobs\n");
+      exit(-1);
+    }
+    j = &jobs[njobs];
+    memset(j, 0, sizeof(*j));
+    arrival = strtoll(p, &end, 10);
+    if (end == p || arrival < 0) goto bad;
+    j->arrival = arrival * 1000;
+    p = end;
+    j->priority = strtol(p, &end, 10);
+    if (end == p) goto bad;
+    p = end;
+    while (*(p += strspn(p, " \t\r\n")) != '\0')
+    {
+      if ((*p != 'c' && *p != 'r') || j->phases == REPLAY_MAX_PHASES) goto bad;
+      j->kind[j->phases] = *p;
+      j->amount[j->phases] = strtoll(p + 1, &end, 10);
+      if (end == p + 1 || j->amount[j->phases] < 0) goto bad;
+      if (*p == 'c')
+      {
+        j->amount[j->phases] *= 1000;
+        j->cpu += j->amount[j->phases];
+      }
+      j->phases++;
+      p = end;
+    }
+    njobs++;
+  }
+  fclose(f);
+  qsort(jobs, njobs, sizeof(struct job), compare_arrival);
+  return;
+
+bad:
+  fprintf(stderr, "*** ERROR: %s:%d: bad job\n", path, n);
+  exit(-1);
+}
+
+
+/* ns since the library started: the whole life of the main thread */
+static long long elapsed()
+{
+  struct mythread_stats s;
+
+  mythread_stats(main_tid, &s);
+  return s.run_ns + s.ready_ns + s.io_ns + s.block_ns;
+}
+
+static void *run_job(void *arg)
+{
+  struct job *j = arg;
+  off_t offset = 0;
+  char *buf = NULL;
+  int fd, i;
+
+  fd = open(data_path, O_RDONLY);
+  for (i = 0; i < j->phases; i++)
+  {
+    if (j->kind[i] == 'c')
+    {
+      mythread_burn(j->amount[i]);
+      continue;
+    }
+    buf = realloc(buf, j->amount[i] > 0 ? j->amount[i] : 1);
+    if (fd == -1 || buf == NULL) continue;
+    //Somewhere else in the file for every job and read
+    offset = (j - jobs + i) * 4096 % (data_size > j->amount[i] ? data_size - j->amount[i] : 1);
+    read_disk(fd, offset, buf, j->amount[i]);
+  }
+  free(buf);
+  if (fd != -1) close(fd);
+  mythread_stats(mythread_gettid(), &j->stats);
+  j->done = 1;
+  return NULL;
+}
+
+/* Turnaround and waiting times, in ms, percentiles over the jobs */
+static void report(const char *policy, long long makespan)
+{
+  double *turnaround = malloc(njobs * sizeof(double));
+  double *waiting = malloc(njobs * sizeof(double));
+  double sum_turnaround = 0, sum_waiting = 0;
+  struct mythread_stats *s;
+  int i;
+
+  for (i = 0; i < njobs; i++)
+  {
+    s = &jobs[i].stats;
+    waiting[i] = (jobs[i].spawned - jobs[i].arrival + s->ready_ns) / 1e6;
+    turnaround[i] = (jobs[i].spawned - jobs[i].arrival + s->run_ns + s->ready_ns + s->io_ns + s->block_ns) / 1e6;
+    sum_turnaround += turnaround[i];
+    sum_waiting += waiting[i];
+  }
+  qsort(turnaround, njobs, sizeof(double), compare_double);
+  qsort(waiting, njobs, sizeof(double), compare_double);
+  dprintf(result_fd, "%-6s %6d %10.3f %10.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+          policy, njobs, makespan / 1e9, njobs / (makespan / 1e9),
+          sum_turnaround / njobs, percentile(turnaround, njobs, 0.5), percentile(turnaround, njobs, 0.95),
+          percentile(turnaround, njobs, 0.99), turnaround[njobs - 1],
+          sum_waiting / njobs, percentile(waiting, njobs, 0.99));
+  free(turnaround);
+  free(waiting);
+}
+
+/* Spawns every job at its arrival. It has the highest priority, so it is never late
+   because of the jobs */
+static void *dispatch(void *arg)
+{
+  const char *policy = arg;
+  mythread_attr_t attr;
+  long long now, ticks, tick = tick_length();
+  int i;
+
+  mythread_attr_init(&attr);
+  attr.stack_size = REPLAY_STACK;
+  for (i = 0; i < njobs; i++)
+  {
+    now = elapsed();
+    if (jobs[i].arrival > now) mythread_sleep(jobs[i].arrival - now);
+    attr.priority = jobs[i].priority;
+    ticks = (jobs[i].cpu + tick - 1) / tick;
+    attr.budget_ticks = ticks + ticks / REPLAY_BUDGET_MARGIN + REPLAY_BUDGET_SLACK;
+    jobs[i].spawned = elapsed();
+    jobs[i].tid = mythread_spawn(run_job, &jobs[i], &attr);
+    //A priority the policy does not have: its highest one
+    if (jobs[i].tid == -3)
+    {
+      attr.priority = HIGH_PRIORITY;
+      jobs[i].tid = mythread_spawn(run_job, &jobs[i], &attr);
+    }
+    if (jobs[i].tid < 0)
+    {
+      dprintf(result_fd, "%-6s error: mythread_spawn %d\n", policy, jobs[i].tid);
+      exit(-1);
+    }
+  }
+  return NULL;
+}
+
+/* Body of the child process: never returns, the library exits at FINISH */
+static void run_replay(const char *policy)
+{
+  int devnull = open("/dev/null", O_WRONLY);
+  mythread_attr_t attr;
+  int i, tid, ejected;
+
+  /* The library messages are not part of the results */
+  dup2(devnull, STDOUT_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  if (realtime) alarm(REPLAY_TIMEOUT);
+  mythread_set_policy(policy);
+  mythread_set_simulation(!realtime);
+
+  main_tid = mythread_gettid();
+  mythread_attr_init(&attr);
+  attr.stack_size = REPLAY_STACK;
+  attr.priority = HIGH_PRIORITY;
+  tid = mythread_spawn(dispatch, (void *) policy, &attr);
+  if (tid < 0)
+  {
+    dprintf(result_fd, "%-6s error: mythread_spawn %d\n", policy, tid);
+    exit(-1);
+  }
+  mythread_join(tid, NULL);
+  for (i = 0; i < njobs; i++) mythread_join(jobs[i].tid, NULL);
+  report(policy, elapsed());
+  for (i = 0, ejected = 0; i < njobs; i++) ejected += !jobs[i].done;
+  if (ejected > 0) dprintf(result_fd, "%-6s error: %d jobs ran out of budget\n", policy, ejected);
+  mythread_exit();
+  exit(-1);
+}
+
+static void replay(const char *policy)
+{
+  char buf[1024];
+  int fds[2], n, status;
+  pid_t pid;
+
+  if (pipe(fds) == -1)
+  {
+    perror("*** ERROR: pipe");
+    exit(-1);
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1)
+  {
+    perror("*** ERROR: fork");
+    exit(-1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    result_fd = fds[1];
+    run_replay(policy);
+  }
+  close(fds[1]);
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) fwrite(buf, 1, n, stdout);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status)) printf("%-6s error: killed by signal %d\n", policy, WTERMSIG(status));
+}
+
+
+int main(int argc, char *argv[])
+{
+  char *defaults[] = { "rr", "rrs", "rrsd" };
+  char **policies = defaults;
+  const char **orders;
+  int i, npolicies = 3, fd;
+
+  if (argc > 1 && strcmp(argv[1], "-r") == 0)
+  {
+    realtime = 1;
+    argc--;
+    argv++;
+  }
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: replay [-r] trace [policy...]\n");
+    exit(-1);
+  }
+  load_trace(argv[1]);
+  if (njobs == 0)
+  {
+    fprintf(stderr, "*** ERROR: no jobs in %s\n", argv[1]);
+    exit(-1);
+  }
+  if (argc > 2)
+  {
+    policies = argv + 2;
+    npolicies = argc - 2;
+  }
+  orders = malloc(npolicies * sizeof(char *));
+  if (orders == NULL)
+  {
+    printf("*** ERROR: failed to allocate the policies\n");
+    exit(-1);
+  }
+  for (i = 0; i < npolicies; i++)
+  {
+    if (mythread_set_policy(policies[i]) < 0)
+    {
+      fprintf(stderr, "*** ERROR: unknown scheduling policy %s\n", policies[i]);
+      exit(-1);
+    }
+    orders[i] = mythread_policy_order();
+  }
+
+  //The reads are done on the program file, dropped from the page cache so they go to the disk
+  data_path = "/proc/self/exe";
+  fd = open(data_path, O_RDONLY);
+  if (fd == -1)
+  {
+    perror("*** ERROR: open");
+    exit(-1);
+  }
+  data_size = lseek(fd, 0, SEEK_END);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+
+  printf("%-6s %6s %10s %10s %9s %9s %9s %9s %9s %9s %9s\n", "policy", "jobs", "makespan_s", "jobs/s",
+         "turn_avg", "turn_p50", "turn_p95", "turn_p99", "turn_max", "wait_avg", "wait_p99");
+  for (i = 0; i < npolicies; i++) replay(policies[i]);
+  printf("(times in ms, %s)\n", realtime ? "real time" : "simulated");
+  printf("Ready threads sorted by:\n");
+  for (i = 0; i < npolicies; i++) printf("%-6s %s\n", policies[i], orders[i]);
+  free(orders);
+  return 0;
+}
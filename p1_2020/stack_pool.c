@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stack_pool.h"
+
+/* A free stack stores the link to the next free stack in its first word */
+struct free_stack
+{
+  struct free_stack* next;
+};
+
+static struct free_stack* free_lists[STACK_POOL_CLASSES];
+static struct stack_pool_stats pool_stats;
+static size_t page_size = 0;
+
+
+static size_t get_page_size()
+{
+  if (page_size == 0) page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+/* Size class of a rounded size, STACK_POOL_CLASSES if it does not fit in any */
+static int stack_class(size_t size)
+{
+  size_t pages = size / get_page_size();
+  int c = 0;
+
+  while (c < STACK_POOL_CLASSES && ((size_t)1 << c) < pages) c++;
+  return c;
+}
+
+/* Maps count stacks of size bytes, each one above a guard page.
+   Returns the lowest address of the first stack */
+static char* stack_map(size_t size, int count)
+{
+  size_t slot = size + get_page_size();
+  char* region;
+  int i;
+
+  region = mmap(NULL, slot * count, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED)
+  {
+    perror("*** ERROR: mmap in stack_map");
+    return NULL;
+  }
+  for (i = 0; i < count; i++)
+  {
+    if (mprotect(region + i * slot, get_page_size(), PROT_NONE) == -1)
+    {
+      perror("*** ERROR: mprotect in stack_map");
+      munmap(region, slot * count);
+      return NULL;
+    }
+  }
+  pool_stats.mapped += slot * count;
+  return region + get_page_size();
+}
+
+
+size_t stack_round(size_t size)
+{
+  size_t pages = (size + get_page_size() - 1) / get_page_size();
+  int c;
+
+  if (pages == 0) pages = 1;
+  c = stack_class(pages * get_page_size());
+  if (c < STACK_POOL_CLASSES) pages = (size_t)1 << c;
+  return pages * get_page_size();
+}
+
+
+void* stack_alloc(size_t size)
+{
+  int c = stack_class(size);
+  struct free_stack* s;
+  char* stacks;
+  int i;
+
+  /* Too big for the pool: a mapping of its own */
+  if (c == STACK_POOL_CLASSES)
+  {
+    pool_stats.misses++;
+    return stack_map(size, 1);
+  }
+
+  if (free_lists[c] == NULL)
+  {
+    pool_stats.misses++;
+    stacks = stack_map(size, STACK_POOL_CHUNK);
+    if (stacks == NULL) return NULL;
+    /* The first one is returned, the rest go to the free list */
+    for (i = STACK_POOL_CHUNK - 1; i > 0; i--)
+    {
+      s = (struct free_stack*)(stacks + i * (size + get_page_size()));
+      s->next = free_lists[c];
+      free_lists[c] = s;
+    }
+    return stacks;
+  }
+
+  pool_stats.hits++;
+  s = free_lists[c];
+  free_lists[c] = s->next;
+  return s;
+}
+
+
+void stack_free(void* stack, size_t size)
+{
+  int c = stack_class(size);
+  struct free_stack* s = stack;
+
+  if (stack == NULL) return;
+  pool_stats.releases++;
+
+  /* Stacks that do not fit in the pool are unmapped at once, with their guard page.
+     The caller runs on another stack: a thread releases its own in finish_switch */
+  if (c == STACK_POOL_CLASSES)
+  {
+    munmap((char*)stack - get_page_size(), size + get_page_size());
+    pool_stats.mapped -= size + get_page_size();
+    return;
+  }
+  s->next = free_lists[c];
+  free_lists[c] = s;
+}
+
+
+void stack_pool_get_stats(struct stack_pool_stats* stats)
+{
+  *stats = pool_stats;
+}
+
+
+void stack_pool_report(FILE* out)
+{
+  unsigned long total = pool_stats.hits + pool_stats.misses;
+
+  fprintf(out, "*** STACK POOL: %lu allocations, %lu hits, %lu misses (hit rate %.1f%%), %lu releases, %lu KB mapped\n",
+          total, pool_stats.hits, pool_stats.misses,
+          total ? 100.0 * pool_stats.hits / total : 0.0,
+          pool_stats.releases, pool_stats.mapped / 1024);
+}
@@ -0,0 +1,35 @@
+#ifndef _STACK_POOL_H_
+#define _STACK_POOL_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Pool of thread stacks built on mmap.
+   Stacks are grouped in size classes (a power of two number of pages) and every
+   class reserves STACK_POOL_CHUNK stacks at once. Each stack has a PROT_NONE guard
+   page below it, so an overflow faults instead of corrupting memory.
+   Released stacks go back to the free list of their class and are recycled */
+
+#define STACK_POOL_CHUNK 16 /* Stacks reserved by each mmap */
+#define STACK_POOL_CLASSES 12 /* Size classes: 1 page .. 2048 pages, bigger stacks are mapped one by one */
+
+struct stack_pool_stats
+{
+  unsigned long hits; /* Allocations served from a free list */
+  unsigned long misses; /* Allocations that needed a new mmap */
+  unsigned long releases; /* Stacks given back to the pool */
+  unsigned long mapped; /* Bytes mapped by the pool, guard pages included */
+};
+
+/* Size that will be actually used for a stack of the requested size */
+size_t stack_round(size_t size);
+/* Returns the lowest address of a stack of stack_round(size) bytes or NULL on error */
+void* stack_alloc(size_t size);
+/* Gives a stack back to the pool. size must be the one used in stack_alloc() */
+void stack_free(void* stack, size_t size);
+
+void stack_pool_get_stats(struct stack_pool_stats* stats);
+/* Prints the pool statistics and the hit rate */
+void stack_pool_report(FILE* out);
+
+#endif
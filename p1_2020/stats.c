@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+int stats_virtual = 0;
+
+/* Reference point of the conversion: both clocks at stats_init() */
+static long long start_count;
+static long long start_nsec;
+
+
+static long long monotonic_nsec()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void stats_init(int virtual_clock)
+{
+  stats_virtual = virtual_clock;
+  start_nsec = monotonic_nsec();
+  start_count = stats_now();
+}
+
+#ifdef STATS_CYCLES
+/* The rate is measured over the whole execution so far, the longer the better. Right
+   after the initialization it is not reliable, the counts are tiny anyway */
+double stats_scale()
+{
+  long long cycles = stats_now() - start_count;
+  long long nsec = monotonic_nsec() - start_nsec;
+
+  if (stats_virtual) return 1.0;
+  if (cycles <= 0 || nsec <= 0) return 1.0;
+  return (double) nsec / cycles;
+}
+#else
+double stats_scale()
+{
+  return 1.0;
+}
+#endif
@@ -0,0 +1,46 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <time.h>
+
+/* Clock of the per thread accounting (see mythread_stats()).
+   It is read at every context switch, so it is the cycle counter where there is one,
+   read with a single instruction and no system call. The counters of the TCBs are kept
+   in its units, they are converted to ns only when they are copied out, by comparing it
+   to CLOCK_MONOTONIC since stats_init(). The cycle counter must be the same in every
+   core, as the constant and synchronized TSC of current x86 processors.
+   Other architectures, or -DMYTHREAD_STATS_CLOCK, use CLOCK_MONOTONIC.
+   A simulation uses its virtual clock (see set_virtual_clock) */
+
+#include "interrupt.h"
+
+extern int stats_virtual;
+
+#if defined(__x86_64__) && !defined(MYTHREAD_STATS_CLOCK)
+#define STATS_CYCLES
+static inline long long stats_now()
+{
+  unsigned int lo, hi;
+
+  if (stats_virtual) return clock_now();
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((long long) hi << 32) | lo;
+}
+#else
+static inline long long stats_now()
+{
+  struct timespec ts;
+
+  if (stats_virtual) return clock_now();
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+#endif
+
+/* Takes the reference point of the conversion, once at the initialization.
+   virtual_clock: the accounting counts ns of the virtual clock */
+void stats_init(int virtual_clock);
+/* ns per stats_now() unit */
+double stats_scale();
+
+#endif
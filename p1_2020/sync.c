@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mythread.h"
+#include "queue.h"
+#include "wait.h"
+
+/* Mutexes, condition variables and semaphores.
+   A thread that has to wait is parked on the wait queue of the object (see wait.h) and
+   the one that releases the object hands it straight to the first waiter: the mutex
+   changes owner, the unit of the semaphore is never seen by the others. So a waiter
+   never has to retry when it runs again.
+   Locking a free mutex and taking an available unit of a semaphore is one atomic
+   instruction, with no lock and no system call. The timed variants return -1 if the
+   object could not be taken in nsec ns (0: no wait) */
+
+
+/****** Mutex ******/
+
+int mythread_mutex_init(mythread_mutex_t *m)
+{
+  m->state = 0;
+  m->owner = -1;
+  m->lock = 0;
+  m->waiters = tcb_queue_new();
+  return m->waiters == NULL ? -1 : 0;
+}
+
+/* Returns -1 if the mutex is locked */
+int mythread_mutex_destroy(mythread_mutex_t *m)
+{
+  if (__atomic_load_n(&m->state, __ATOMIC_RELAXED) != 0) return -1;
+  free(m->waiters);
+  m->waiters = NULL;
+  return 0;
+}
+
+int mythread_mutex_lock(mythread_mutex_t *m)
+{
+  return mythread_mutex_timedlock(m, -1);
+}
+
+int mythread_mutex_trylock(mythread_mutex_t *m)
+{
+  int me = mythread_gettid();
+  int unlocked = 0;
+
+  if (!__atomic_compare_exchange_n(&m->state, &unlocked, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return -1;
+  m->owner = me;
+  return 0;
+}
+
+int mythread_mutex_timedlock(mythread_mutex_t *m, long long nsec)
+{
+  int me = mythread_gettid();
+  int unlocked = 0;
+
+  if (__atomic_compare_exchange_n(&m->state, &unlocked, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    m->owner = me;
+    return 0;
+  }
+
+  wait_lock(&m->lock);
+  //From now on the owner takes the slow path of the unlock, unless it was unlocked in between
+  if (__atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE) == 0) {
+    if (tcb_queue_empty(m->waiters)) __atomic_store_n(&m->state, 1, __ATOMIC_RELAXED);
+    m->owner = me;
+    wait_unlock(&m->lock);
+    return 0;
+  }
+  //The owner makes it ours before resuming us (see mythread_mutex_unlock)
+  return wait_park(m->waiters, &m->lock, nsec);
+}
+
+/* Returns -1 if the caller is not the owner */
+int mythread_mutex_unlock(mythread_mutex_t *m)
+{
+  int locked = 1;
+  TCB *t;
+
+  if (m->owner != mythread_gettid()) return -1;
+  m->owner = -1;
+  if (__atomic_compare_exchange_n(&m->state, &locked, 0, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return 0;
+
+  wait_lock(&m->lock);
+  t = wait_dequeue(m->waiters);
+  if (t == NULL) {
+    //The waiters timed out
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+  } else {
+    //Handed over, it stays locked
+    m->owner = t->tid;
+    if (tcb_queue_empty(m->waiters)) __atomic_store_n(&m->state, 1, __ATOMIC_RELAXED);
+  }
+  wait_unlock(&m->lock);
+  if (t != NULL) wait_resume(t);
+  return 0;
+}
+
+
+/****** Condition variable ******/
+
+int mythread_cond_init(mythread_cond_t *c)
+{
+  c->lock = 0;
+  c->waiters = tcb_queue_new();
+  return c->waiters == NULL ? -1 : 0;
+}
+
+/* Returns -1 if there are waiters */
+int mythread_cond_destroy(mythread_cond_t *c)
+{
+  if (!tcb_queue_empty(c->waiters)) return -1;
+  free(c->waiters);
+  c->waiters = NULL;
+  return 0;
+}
+
+int mythread_cond_wait(mythread_cond_t *c, mythread_mutex_t *m)
+{
+  return mythread_cond_timedwait(c, m, -1);
+}
+
+/* Returns -2 if the caller does not own m */
+int mythread_cond_timedwait(mythread_cond_t *c, mythread_mutex_t *m, long long nsec)
+{
+  int ret;
+
+  //m is unlocked inside the lock of c, so a signal after the unlock finds us parked
+  wait_lock(&c->lock);
+  if (mythread_mutex_unlock(m) < 0) {
+    wait_unlock(&c->lock);
+    return -2;
+  }
+  ret = wait_park(c->waiters, &c->lock, nsec);
+  mythread_mutex_lock(m);
+  return ret;
+}
+
+int mythread_cond_signal(mythread_cond_t *c)
+{
+  TCB *t;
+
+  wait_lock(&c->lock);
+  t = wait_dequeue(c->waiters);
+  wait_unlock(&c->lock);
+  if (t != NULL) wait_resume(t);
+  return 0;
+}
+
+int mythread_cond_broadcast(mythread_cond_t *c)
+{
+  TCB *t;
+
+  wait_lock(&c->lock);
+  while ((t = wait_dequeue(c->waiters)) != NULL) wait_resume(t);
+  wait_unlock(&c->lock);
+  return 0;
+}
+
+
+/****** Semaphore ******/
+
+int mythread_sem_init(mythread_sem_t *s, int value)
+{
+  if (value < 0) return -1;
+  s->value = value;
+  s->lock = 0;
+  s->waiters = tcb_queue_new();
+  return s->waiters == NULL ? -1 : 0;
+}
+
+/* Returns -1 if there are waiters */
+int mythread_sem_destroy(mythread_sem_t *s)
+{
+  if (!tcb_queue_empty(s->waiters)) return -1;
+  free(s->waiters);
+  s->waiters = NULL;
+  return 0;
+}
+
+/* Takes a unit if there is one, without the lock */
+static int sem_take(mythread_sem_t *s)
+{
+  int value = __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+
+  while (value > 0)
+    if (__atomic_compare_exchange_n(&s->value, &value, value - 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return 0;
+  return -1;
+}
+
+int mythread_sem_wait(mythread_sem_t *s)
+{
+  return mythread_sem_timedwait(s, -1);
+}
+
+int mythread_sem_trywait(mythread_sem_t *s)
+{
+  return sem_take(s);
+}
+
+int mythread_sem_timedwait(mythread_sem_t *s, long long nsec)
+{
+  if (sem_take(s) == 0) return 0;
+
+  //A post always takes the lock, so it finds us parked if the value is still 0
+  wait_lock(&s->lock);
+  if (sem_take(s) == 0) {
+    wait_unlock(&s->lock);
+    return 0;
+  }
+  return wait_park(s->waiters, &s->lock, nsec);
+}
+
+int mythread_sem_post(mythread_sem_t *s)
+{
+  TCB *t;
+
+  wait_lock(&s->lock);
+  t = wait_dequeue(s->waiters);
+  //With no waiters the unit is left for the next wait
+  if (t == NULL) __atomic_add_fetch(&s->value, 1, __ATOMIC_RELEASE);
+  wait_unlock(&s->lock);
+  if (t != NULL) wait_resume(t);
+  return 0;
+}
+
+int mythread_sem_getvalue(mythread_sem_t *s)
+{
+  return __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+}
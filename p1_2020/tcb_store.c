@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "tcb_store.h"
+
+static TCB* segments[TCB_MAX_SEGMENTS];
+static int num_segments = 0;
+
+/* Free slots, linked through tcb->next */
+static TCB* free_list = NULL;
+
+
+/* Allocate a new segment and put its slots in the free list */
+static int tcb_store_grow()
+{
+  TCB* segment;
+  int i;
+
+  if (num_segments == TCB_MAX_SEGMENTS) return -1;
+
+  segment = calloc(TCB_SEGMENT_SIZE, sizeof(TCB));
+  if (segment == NULL)
+  {
+    printf("*** ERROR: failed to allocate a TCB segment\n");
+    return -1;
+  }
+
+  /* Pushed in reverse order so lower tids are handed out first */
+  for (i = TCB_SEGMENT_SIZE - 1; i >= 0; i--)
+  {
+    segment[i].tid = num_segments * TCB_SEGMENT_SIZE + i;
+    segment[i].state = FREE;
+    segment[i].next = free_list;
+    free_list = &segment[i];
+  }
+  segments[num_segments++] = segment;
+  return 0;
+}
+
+
+TCB* tcb_alloc()
+{
+  TCB* tcb;
+
+  if (free_list == NULL && tcb_store_grow() == -1) return NULL;
+
+  tcb = free_list;
+  free_list = tcb->next;
+  tcb->next = NULL;
+  return tcb;
+}
+
+
+void tcb_release(TCB* tcb)
+{
+  tcb->state = FREE;
+  /* Back to the first generation before the tid overflows */
+  if (tcb->tid <= INT_MAX - MAX_THREADS) tcb->tid += MAX_THREADS;
+  else tcb->tid &= MAX_THREADS - 1;
+  tcb->next = free_list;
+  free_list = tcb;
+}
+
+
+TCB* tcb_get(int tid)
+{
+  TCB* tcb;
+
+  if (tid < 0) return NULL;
+  tcb = tcb_slot(tid & (MAX_THREADS - 1));
+  if (tcb == NULL || tcb->tid != tid) return NULL;
+  return tcb;
+}
+
+
+TCB* tcb_slot(int slot)
+{
+  if (slot < 0 || slot >= num_segments * TCB_SEGMENT_SIZE) return NULL;
+  return &segments[slot >> TCB_SEGMENT_SHIFT][slot & (TCB_SEGMENT_SIZE - 1)];
+}
+
+
+int tcb_capacity() { return num_segments * TCB_SEGMENT_SIZE; }
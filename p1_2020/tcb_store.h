@@ -0,0 +1,30 @@
+#ifndef _TCB_STORE_H_
+#define _TCB_STORE_H_
+
+#include "mythread.h"
+
+/* Growable store of thread control blocks.
+   TCBs live in fixed size segments that are allocated on demand and never moved,
+   so TCB pointers stay valid. Free slots are kept in a LIFO free list linked
+   through tcb->next, so allocation and release are O(1) and released slots are recycled.
+   The tid of a TCB is its slot number plus a generation, times MAX_THREADS, that goes up
+   every time the slot is released: tid -> TCB lookup is O(1) too, and the tid of a
+   released thread is not found even after its slot was reused */
+
+#define TCB_SEGMENT_SHIFT 10
+#define TCB_SEGMENT_SIZE (1 << TCB_SEGMENT_SHIFT) /* TCBs per segment */
+#define TCB_MAX_SEGMENTS (MAX_THREADS / TCB_SEGMENT_SIZE)
+
+/* Take a free slot, growing the store by one segment if needed.
+   Returns NULL when MAX_THREADS are alive or memory is exhausted */
+TCB* tcb_alloc();
+/* Mark the slot FREE and give it the tid of its next generation */
+void tcb_release(TCB* tcb);
+/* Returns the TCB with the given tid or NULL if the tid was never allocated or was released */
+TCB* tcb_get(int tid);
+/* Returns the TCB in the given slot, 0 .. tcb_capacity() - 1, whatever its generation */
+TCB* tcb_slot(int slot);
+/* Number of slots allocated so far (upper bound of live threads) */
+int tcb_capacity();
+
+#endif
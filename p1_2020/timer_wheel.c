@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "timer_wheel.h"
+
+#if WHEEL_SLOTS != 64
+#error "the slots of a level are kept in a 64 bit bitmap"
+#endif
+
+/* First tick bit that selects the slot of a level */
+#define SHIFT(level) ((level) * WHEEL_BITS)
+
+
+/* Bitmap rotated so that bit 0 is slot first */
+static inline uint64_t rotate(uint64_t bitmap, int first)
+{
+  return first == 0 ? bitmap : (bitmap >> first) | (bitmap << (WHEEL_SLOTS - first));
+}
+
+/* Puts t in the slot of the tick e, never before the current one */
+static void link_timer(struct timer_wheel *w, struct wheel_timer *t, long e)
+{
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if ((e >> SHIFT(level)) - (w->now >> SHIFT(level)) < WHEEL_SLOTS) break;
+  //Out of range: the last slot of the top level, it is placed again from there
+  if ((e >> SHIFT(level)) - (w->now >> SHIFT(level)) >= WHEEL_SLOTS)
+    e = ((w->now >> SHIFT(level)) + WHEEL_SLOTS - 1) << SHIFT(level);
+
+  slot = (e >> SHIFT(level)) & (WHEEL_SLOTS - 1);
+  t->level = level;
+  t->slot = slot;
+  t->prev = NULL;
+  t->next = w->slots[level][slot];
+  if (t->next != NULL) t->next->prev = t;
+  w->slots[level][slot] = t;
+  w->bitmap[level] |= (uint64_t) 1 << slot;
+}
+
+/* Takes the whole list of a slot */
+static struct wheel_timer* take_slot(struct timer_wheel *w, int level, int slot)
+{
+  struct wheel_timer *list = w->slots[level][slot];
+
+  w->slots[level][slot] = NULL;
+  w->bitmap[level] &= ~((uint64_t) 1 << slot);
+  return list;
+}
+
+
+void wheel_init(struct timer_wheel *w, long now)
+{
+  int level, slot;
+
+  w->now = now;
+  w->armed = 0;
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    w->bitmap[level] = 0;
+    for (slot = 0; slot < WHEEL_SLOTS; slot++) w->slots[level][slot] = NULL;
+  }
+}
+
+void wheel_timer_init(struct wheel_timer *t, void *data)
+{
+  t->next = t->prev = NULL;
+  t->level = -1;
+  t->data = data;
+}
+
+void wheel_add(struct timer_wheel *w, struct wheel_timer *t, long expires)
+{
+  t->expires = expires;
+  link_timer(w, t, expires > w->now ? expires : w->now + 1);
+  w->armed++;
+}
+
+int wheel_del(struct timer_wheel *w, struct wheel_timer *t)
+{
+  if (t->level < 0) return -1;
+  if (t->prev != NULL) t->prev->next = t->next;
+  else w->slots[t->level][t->slot] = t->next;
+  if (t->next != NULL) t->next->prev = t->prev;
+  if (w->slots[t->level][t->slot] == NULL) w->bitmap[t->level] &= ~((uint64_t) 1 << t->slot);
+  t->next = t->prev = NULL;
+  t->level = -1;
+  w->armed--;
+  return 0;
+}
+
+int wheel_pending(struct wheel_timer *t)
+{
+  return t->level >= 0;
+}
+
+long wheel_next_event(struct timer_wheel *w)
+{
+  long next = LONG_MAX, tick, current;
+  int level, distance;
+
+  if (w->armed == 0) return LONG_MAX;
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    if (w->bitmap[level] == 0) continue;
+    //The slots are processed in order from the one after the current one
+    current = w->now >> SHIFT(level);
+    distance = __builtin_ctzll(rotate(w->bitmap[level], (current + 1) & (WHEEL_SLOTS - 1)));
+    tick = (current + 1 + distance) << SHIFT(level);
+    if (tick < next) next = tick;
+  }
+  return next;
+}
+
+struct wheel_timer* wheel_advance(struct timer_wheel *w, long now)
+{
+  struct wheel_timer *expired = NULL, **tail = &expired, *list, *t;
+  long tick;
+  int level;
+
+  while (w->now < now) {
+    //Straight to the next slot to process, the empty ones are skipped
+    tick = wheel_next_event(w);
+    if (tick > now) {
+      w->now = now;
+      break;
+    }
+    w->now = tick;
+
+    //Higher levels first, a timer can go down several levels at the same tick
+    for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+      if ((tick & ((1L << SHIFT(level)) - 1)) != 0) continue;
+      list = take_slot(w, level, (tick >> SHIFT(level)) & (WHEEL_SLOTS - 1));
+      while (list != NULL) {
+        t = list;
+        list = t->next;
+        link_timer(w, t, t->expires);
+      }
+    }
+
+    list = take_slot(w, 0, tick & (WHEEL_SLOTS - 1));
+    while (list != NULL) {
+      t = list;
+      list = t->next;
+      t->prev = NULL;
+      t->level = -1;
+      w->armed--;
+      *tail = t;
+      tail = &t->next;
+    }
+  }
+  *tail = NULL;
+  return expired;
+}
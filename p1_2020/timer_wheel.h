@@ -0,0 +1,55 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdint.h>
+
+/* Hierarchical timing wheel.
+   WHEEL_LEVELS levels of WHEEL_SLOTS slots, each slot a doubly linked list of timers.
+   A timer goes to the lowest level whose slots still tell its expiry apart from now,
+   and moves down one level (cascades) when the wheel reaches its slot. Adding and
+   removing a timer is O(1). A bitmap per level marks the non empty slots, so advancing
+   the wheel jumps straight to the next slot to process and costs nothing when there
+   are no timers. Times are in ticks of the caller, the wheel never reads a clock.
+   Expiries beyond the range of the wheel (WHEEL_SLOTS ^ WHEEL_LEVELS ticks) wait in
+   the last slot of the top level and are placed again when it is reached */
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+struct wheel_timer
+{
+  long expires; /* Tick of the expiry */
+  struct wheel_timer *next;
+  struct wheel_timer *prev;
+  int level; /* -1 when the timer is not in the wheel */
+  int slot;
+  void *data; /* Owner of the timer */
+};
+
+struct timer_wheel
+{
+  long now; /* Last tick processed */
+  int armed; /* Timers in the wheel */
+  uint64_t bitmap[WHEEL_LEVELS]; /* Bit s is set when slots[level][s] is not empty */
+  struct wheel_timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+/* Empty wheel, with now as the current tick */
+void wheel_init(struct timer_wheel *w, long now);
+/* Initialize a timer that is not in any wheel, owned by data */
+void wheel_timer_init(struct wheel_timer *t, void *data);
+/* Insert a timer that expires at tick expires (at the next tick if it is not after now) */
+void wheel_add(struct timer_wheel *w, struct wheel_timer *t, long expires);
+/* Remove a timer. Returns 0, or -1 if it was not in the wheel (expired or never added) */
+int wheel_del(struct timer_wheel *w, struct wheel_timer *t);
+/* Return 1 if the timer is in a wheel and 0 otherwise */
+int wheel_pending(struct wheel_timer *t);
+/* Advance the wheel to tick now. Returns the expired timers in expiry order, linked by
+   next, NULL if none */
+struct wheel_timer* wheel_advance(struct timer_wheel *w, long now);
+/* First tick after now with a slot to process, the earliest possible expiry.
+   LONG_MAX if the wheel is empty */
+long wheel_next_event(struct timer_wheel *w);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+#include "interrupt.h"
+
+static struct trace_event ring[TRACE_RING_SIZE];
+/* Events recorded so far, the next one goes to ring[head % TRACE_RING_SIZE] */
+static uint64_t head = 0;
+static int print_sink = 0;
+
+
+/* Classic human readable message of an event */
+static void print_event(int type, int reason, int tid, int arg)
+{
+  switch (type)
+  {
+  case TRACE_SWITCH:
+    if (reason == TRACE_SLICE) printf("*** SWAPCONTEXT FROM %d TO %d\n", tid, arg);
+    else if (reason == TRACE_PREEMPT) printf("*** THREAD %d PREEMPTED: SET CONTEXT OF %d\n", tid, arg);
+    else if (reason == TRACE_FINISH) printf("*** THREAD %d FINISHED: SET CONTEXT OF %d\n", tid, arg);
+    else if (reason == TRACE_IDLE) printf("*** THREAD READY: SET CONTEXT TO %d\n", arg);
+    break;
+  case TRACE_READY:
+    if (reason == TRACE_IO) printf("*** THREAD %d READY\n", tid);
+    break;
+  case TRACE_WAIT:
+    if (reason == TRACE_IO) printf("*** THREAD %d READ  FROM  DISK\n", tid);
+    break;
+  case TRACE_EJECT:
+    printf("*** THREAD %d EJECTED\n", tid);
+    break;
+  case TRACE_END:
+    printf("*** THREAD %d FINISHED\n", tid);
+    break;
+  default:
+    break;
+  }
+}
+
+
+void trace_event(int type, int reason, int tid, int priority, int arg, int cpu)
+{
+  struct trace_event* e;
+  uint64_t pos;
+  /* vDSO: no system call. The virtual clock in a simulation */
+  long long now = clock_now();
+
+  pos = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  e = &ring[pos & (TRACE_RING_SIZE - 1)];
+
+  /* The record is invalid while it is written */
+  __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  e->ts = now;
+  e->tid = tid;
+  e->arg = arg;
+  e->priority = priority;
+  e->type = type;
+  e->reason = reason;
+  e->cpu = cpu;
+  __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+
+  if (print_sink) print_event(type, reason, tid, arg);
+}
+
+
+void trace_print(int on)
+{
+  print_sink = on;
+}
+
+
+int trace_save(const char* path)
+{
+  struct trace_header header;
+  uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  uint64_t pos = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+  FILE* f = fopen(path, "wb");
+
+  if (f == NULL)
+  {
+    perror("*** ERROR: trace_save");
+    return -1;
+  }
+
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.count = 0;
+  header.dropped = pos;
+  fwrite(&header, sizeof(header), 1, f);
+
+  /* Records still being written (or already overwritten) are skipped */
+  for (; pos < end; pos++)
+  {
+    struct trace_event e = ring[pos & (TRACE_RING_SIZE - 1)];
+    if (e.seq != pos + 1) continue;
+    fwrite(&e, sizeof(e), 1, f);
+    header.count++;
+  }
+
+  rewind(f);
+  fwrite(&header, sizeof(header), 1, f);
+  if (fclose(f) != 0)
+  {
+    perror("*** ERROR: trace_save");
+    return -1;
+  }
+  return 0;
+}
+
+
+void trace_finish()
+{
+  char* path = getenv("MYTHREAD_TRACE");
+
+  if (path != NULL && path[0] != '\0') trace_save(path);
+}
@@ -0,0 +1,67 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+/* Scheduler event trace.
+   Events are stored in a fixed size ring of binary records, without locks or system
+   calls, so they can be recorded from the interrupt handlers and from several workers
+   at once. When the ring is full the oldest events are overwritten.
+   The ring is saved with trace_save() (at FINISH, to the file named by the
+   MYTHREAD_TRACE environment variable) and trace_dump converts it to the Chrome /
+   Perfetto trace JSON format.
+   The classic "*** ..." messages are printed by an optional sink, off by default since
+   it calls printf() from the interrupt handlers. It is enabled with trace_print(1) or
+   the MYTHREAD_TRACE_PRINT=1 environment variable */
+
+#define TRACE_RING_SIZE (1 << 16) /* Events kept, a power of two */
+#define TRACE_MAGIC "MTTRACE1"
+
+/* Event types */
+#define TRACE_SWITCH 0 /* tid leaves the CPU to arg */
+#define TRACE_READY 1 /* tid is ready again */
+#define TRACE_WAIT 2 /* tid waits for an I/O */
+#define TRACE_EJECT 3 /* tid is ejected */
+#define TRACE_END 4 /* tid is the last thread, the execution finishes */
+
+/* Reasons */
+#define TRACE_NONE 0
+#define TRACE_SLICE 1 /* end of the time slice (or of the wait for the CPU) */
+#define TRACE_PREEMPT 2 /* a higher priority thread is ready */
+#define TRACE_FINISH 3 /* tid has finished */
+#define TRACE_IDLE 4 /* tid is the idle thread */
+#define TRACE_IO 5 /* disk read */
+#define TRACE_TIMER 6 /* sleep, or the timeout of a wait */
+#define TRACE_SYNC 7 /* mutex, condition variable, semaphore, channel or join */
+
+struct trace_event
+{
+  uint64_t ts; /* CLOCK_MONOTONIC, ns */
+  int32_t tid;
+  int32_t arg; /* Next thread of a TRACE_SWITCH */
+  int16_t priority;
+  uint8_t type;
+  uint8_t reason;
+  uint16_t cpu; /* Worker that recorded the event */
+  uint16_t pad;
+  uint64_t seq; /* Position + 1 once the record is complete */
+};
+
+/* Binary file written by trace_save(): header followed by count events, oldest first */
+struct trace_header
+{
+  char magic[8];
+  uint64_t count;
+  uint64_t dropped; /* Events overwritten before the save */
+};
+
+/* Records an event. Safe from the interrupt handlers */
+void trace_event(int type, int reason, int tid, int priority, int arg, int cpu);
+/* Enables (1) or disables (0) the printf sink */
+void trace_print(int on);
+/* Writes the ring to path. Returns 0 or -1 on error */
+int trace_save(const char* path);
+/* trace_save() to $MYTHREAD_TRACE if it is set */
+void trace_finish();
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+/* Converts a trace saved by trace_save() to the Chrome / Perfetto trace JSON format
+   (open it in ui.perfetto.dev or chrome://tracing).
+   Every thread is a track: a "run" slice for each time it holds a worker, and instant
+   events when it gets ready, waits for the disk or is ejected.
+   Usage: trace_dump trace.bin > trace.json */
+
+#define MAX_CPUS 1024
+#define MAX_NAMED (1 << 20) /* Threads with a track name */
+#define IDLE_TID 1000000000 /* Track of the idle thread of worker c: IDLE_TID + c */
+
+static const char* reason_names[] = {"none", "slice", "preempt", "finish", "idle", "io", "timer", "sync"};
+static const char* type_names[] = {"switch", "ready", "wait", "eject", "end"};
+
+/* Thread running on each worker and since when */
+static int running[MAX_CPUS];
+static uint64_t since[MAX_CPUS];
+static int first_event = 1;
+static char idle_named[MAX_CPUS];
+static char* named;
+
+
+static int track(int tid, int cpu)
+{
+  return tid < 0 ? IDLE_TID + cpu : tid;
+}
+
+/* Microseconds since base. Workers take their timestamps concurrently, so an event can
+   be recorded slightly before the previous one */
+static double usec(uint64_t ts, uint64_t base)
+{
+  return (int64_t)(ts - base) / 1e3;
+}
+
+static void separator()
+{
+  if (!first_event) printf(",\n");
+  first_event = 0;
+}
+
+static void run_slice(int tid, int cpu, uint64_t from, uint64_t to, uint64_t base, int reason)
+{
+  separator();
+  printf("{\"name\":\"run\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+         "\"args\":{\"worker\":%d,\"leaves\":\"%s\"}}",
+         track(tid, cpu), usec(from, base), usec(to, from), cpu,
+         reason_names[reason < 8 ? reason : 0]);
+}
+
+static void thread_name(int tid, int cpu)
+{
+  separator();
+  if (tid < 0)
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"idle %d\"}}",
+           track(tid, cpu), cpu);
+  else
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+           tid, tid);
+}
+
+/* Emits the track name the first time a thread is seen */
+static void name_once(int tid, int cpu)
+{
+  if (tid < 0)
+  {
+    if (idle_named[cpu]) return;
+    idle_named[cpu] = 1;
+  }
+  else
+  {
+    if (named == NULL || tid >= MAX_NAMED || named[tid]) return;
+    named[tid] = 1;
+  }
+  thread_name(tid, cpu);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct trace_header header;
+  struct trace_event* events;
+  uint64_t i, base, last;
+  int c;
+  FILE* f;
+
+  if (argc != 2)
+  {
+    fprintf(stderr, "Usage: %s trace.bin > trace.json\n", argv[0]);
+    exit(-1);
+  }
+  f = fopen(argv[1], "rb");
+  if (f == NULL)
+  {
+    perror("*** ERROR: fopen");
+    exit(-1);
+  }
+  if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRACE_MAGIC, 8) != 0)
+  {
+    fprintf(stderr, "*** ERROR: %s is not a trace file\n", argv[1]);
+    exit(-1);
+  }
+  events = malloc(header.count * sizeof(struct trace_event) + 1);
+  if (events == NULL || fread(events, sizeof(struct trace_event), header.count, f) != header.count)
+  {
+    fprintf(stderr, "*** ERROR: truncated trace file %s\n", argv[1]);
+    exit(-1);
+  }
+  fclose(f);
+
+  base = header.count > 0 ? events[0].ts : 0;
+  last = header.count > 0 ? events[header.count - 1].ts : 0;
+  for (c = 0; c < MAX_CPUS; c++)
+  {
+    running[c] = -2;
+    since[c] = base;
+  }
+  named = calloc(MAX_NAMED, 1);
+
+  printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%llu},\"traceEvents\":[\n",
+         (unsigned long long) header.dropped);
+
+  for (i = 0; i < header.count; i++)
+  {
+    struct trace_event* e = &events[i];
+    int cpu = e->cpu < MAX_CPUS ? e->cpu : MAX_CPUS - 1;
+
+    name_once(e->tid, cpu);
+
+    if (e->type == TRACE_SWITCH)
+    {
+      /* Before the first switch of a worker its thread ran since the start of the trace */
+      run_slice(e->tid, cpu, running[cpu] == e->tid ? since[cpu] : base, e->ts, base, e->reason);
+      running[cpu] = e->arg;
+      since[cpu] = e->ts;
+      name_once(e->arg, cpu);
+      continue;
+    }
+
+    separator();
+    printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+           "\"args\":{\"worker\":%d,\"priority\":%d,\"reason\":\"%s\"}}",
+           e->type < 5 ? type_names[e->type] : "unknown", track(e->tid, cpu), usec(e->ts, base),
+           cpu, e->priority, reason_names[e->reason < 8 ? e->reason : 0]);
+  }
+
+  /* Threads still running at the end of the trace */
+  for (c = 0; c < MAX_CPUS; c++)
+    if (running[c] != -2) run_slice(running[c], c, since[c], last, base, TRACE_NONE);
+
+  printf("\n]}\n");
+  free(named);
+  free(events);
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _WAIT_H_
+#define _WAIT_H_
+
+#include "mythread.h"
+#include "queue.h"
+
+/* Wait queues of the synchronization objects (see sync.c) and of the channels (chan.c).
+   A thread that has to wait is parked on the tcb_queue of the object: it leaves the CPU
+   in the WAITING state until another thread takes it out with wait_dequeue() and makes
+   it ready with wait_resume(), or until its timeout expires.
+   Every object has a spin lock that protects its queue. It defers the interrupts while
+   it is held, so the holder is never preempted, and takes no system call */
+
+/* Takes and releases the lock of an object */
+void wait_lock(int *lock);
+void wait_unlock(int *lock);
+/* Parks the calling thread on q. lock is the lock of q, held by the caller: it is
+   released once the thread is off the CPU, so it can not be resumed before.
+   nsec < 0 waits with no timeout, nsec == 0 does not wait.
+   Returns 0 when resumed by wait_resume(), -1 on timeout */
+int wait_park(struct tcb_queue *q, int *lock, long long nsec);
+/* Same, for the waiters kept in lists of their own (several at once for a select):
+   the caller has linked the calling thread wherever it waits and holds the locks of
+   those lists. unlock(arg) is called once the thread is off the CPU. The thread unlinks
+   itself when it runs again, the timer does not know where it waits.
+   Returns the wait_result left in its TCB by the waker (0 unless it sets one) */
+int wait_park_unlock(void (*unlock)(void *), void *arg, long long nsec);
+/* Takes the first thread parked on q, with its lock held, skipping the ones that timed
+   out. The thread is resumed by the caller with wait_resume(). NULL if there is none */
+TCB* wait_dequeue(struct tcb_queue *q);
+/* Takes a parked thread found by the caller in one of its lists. Returns 1 if the caller
+   has to resume it, 0 if another waker or its timer took it first */
+int wait_claim(TCB *t);
+/* Makes ready, in the worker of the caller, a thread taken with wait_dequeue() or wait_claim() */
+void wait_resume(TCB *t);
+
+#endif